@@ -28,6 +28,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>	/* DHH 1/23/03 */
+#include "8039dasm.h"
 
 /*#include "memory.h"*/	/* DHH 1/23/03 */
 
@@ -36,111 +37,21 @@ typedef unsigned char byte;
 #define FMT(a,b) a, b
 #define PTRS_PER_FORMAT 2
 
+/* The decoder, from the instruction set table. */
 const char *Formats[] = {
-	FMT("00000011dddddddd", "add  a,#$%X"),
-	FMT("01101rrr", "add  a,%R"),
-	FMT("0110000r", "add  a,@%R"),
-	FMT("00010011dddddddd", "addc a,#$%X"),
-	FMT("01111rrr", "addc a,%R"),
-	FMT("0111000r", "addc a,@%R"),
-	FMT("01010011dddddddd", "anl  a,#$%X"),
-	FMT("01011rrr", "anl  a,%R"),
-	FMT("0101000r", "anl  a,@%R"),
-	FMT("10011000dddddddd", "anl  bus,#$%X"),
-	FMT("10011001dddddddd", "anl  p1,#$%X"),
-	FMT("10011010dddddddd", "anl  p2,#$%X"),
-	FMT("100111pp", "anld %P,a"),
-	FMT("aaa10100aaaaaaaa", "call %A"),
-	FMT("00100111", "clr  a"),
-	FMT("10010111", "clr  c"),
-	FMT("10100101", "clr  f1"),
-	FMT("10000101", "clr  f0"),
-	FMT("00110111", "cpl  a"),
-	FMT("10100111", "cpl  c"),
-	FMT("10010101", "cpl  f0"),
-	FMT("10110101", "cpl  f1"),
-	FMT("01010111", "da   a"),
-	FMT("00000111", "dec  a"),
-	FMT("11001rrr", "dec  %R"),
-	FMT("00010101", "dis  i"),
-	FMT("00110101", "dis  tcnti"),
-	FMT("11101rrraaaaaaaa", "djnz %R,%J"),
-	FMT("00000101", "en   i"),
-	FMT("00100101", "en   tcnti"),
-	FMT("01110101", "ent0 clk"),
-	FMT("00001001", "in   a,p1"),
-	FMT("00001010", "in   a,p2"),
-	FMT("00010111", "inc  a"),
-	FMT("00011rrr", "inc  %R"),
-	FMT("0001000r", "inc  @%R"),
-	FMT("00001000", "ins  a,bus"),
-	FMT("0001 0110aaaaaaaa", "jtf  %J"),
-	FMT("0010 0110aaaaaaaa", "jnt0 %J"),
-	FMT("0011 0110aaaaaaaa", "jt0  %J"),
-	FMT("0100 0110aaaaaaaa", "jnt1 %J"),
-	FMT("0101 0110aaaaaaaa", "jt1  %J"),
-	FMT("0111 0110aaaaaaaa", "jf1  %J"),
-	FMT("1000 0110aaaaaaaa", "jni  %J"),
-	FMT("1001 0110aaaaaaaa", "jnz  %J"),
-	FMT("1011 0110aaaaaaaa", "jf0  %J"),
-	FMT("1100 0110aaaaaaaa", "jz   %J"),
-	FMT("1110 0110aaaaaaaa", "jnc  %J"),
-	FMT("1111 0110aaaaaaaa", "jc   %J"),
-	FMT("bbb10010aaaaaaaa", "jb%B  %J"),
-	FMT("aaa00100aaaaaaaa", "jmp  %A"),
-	FMT("10110011", "jmpp @a"),
-	FMT("00100011dddddddd", "mov  a,#$%X"),
-	FMT("11111rrr", "mov  a,%R"),
-	FMT("1111000r", "mov  a,@%R"),
-	FMT("11000111", "mov  a,psw"),
-	FMT("10111rrrdddddddd", "mov  %R,#$%X"),
-	FMT("10101rrr", "mov  %R,a"),
-	FMT("1010000r", "mov  @%R,a"),
-	FMT("1011000rdddddddd", "mov  @%R,#$%X"),
-	FMT("11010111", "mov  psw,a"),
-	FMT("000011pp", "movd a,%P"),
-	FMT("001111pp", "movd %P,a"),
-	FMT("01000010", "mov  a,t"),
-	FMT("01100010", "mov  t,a"),
-	FMT("11100011", "movp3 a,@a"),
-	FMT("10100011", "movp a,@a"),
-	FMT("1000000r", "movx a,@%R"),
-	FMT("1001000r", "movx @%R,a"),
-	FMT("0100 1rrr", "orl  a,%R"),
-	FMT("0100 000r", "orl  a,@%R"),
-	FMT("0100 0011dddddddd", "orl  a,#$%X"),
-	FMT("1000 1000dddddddd", "orl  bus,#$%X"),
-	FMT("1000 1001dddddddd", "orl  p1,#$%X"),
-	FMT("1000 1010dddddddd", "orl  p2,#$%X"),
-	FMT("1000 11pp", "orld %P,a"),
-	FMT("00000010", "outl bus,a"),
-	/*FMT("001110pp", "outl %p,a"),*/
-	FMT("00111001", "outl p1,a"),
-	FMT("00111010", "outl p2,a"),
-	FMT("10000011", "ret"),
-	FMT("10010011", "retr"),
-	FMT("11100111", "rl   a"),
-	FMT("11110111", "rlc  a"),
-	FMT("01110111", "rr   a"),
-	FMT("01100111", "rrc  a"),
-	FMT("11100101", "sel  mb0"),
-	FMT("11110101", "sel  mb1"),
-	FMT("11000101", "sel  rb0"),
-	FMT("11010101", "sel  rb1"),
-	FMT("01100101", "stop tcnt"),
-	FMT("01000101", "strt cnt"),
-	FMT("01010101", "strt t"),
-	FMT("01000111", "swap a"),
-	FMT("00101rrr", "xch  a,%R"),
-	FMT("0010000r", "xch  a,@%R"),
-	FMT("0011000r", "xchd a,@%R"),
-	FMT("1101 0011dddddddd", "xrl  a,#$%X"),
-	FMT("1101 1rrr", "xrl  a,%R"),
-	FMT("1101 000r", "xrl  a,@%R"),
-	FMT("00000000", "nop"),
+#define INSN(encoding, format, cycles) FMT(encoding, format),
+#include "isa48.h"
+#undef INSN
 	NULL
 };
 
+/* Machine cycles, in the same order. */
+static const byte Cycles[] = {
+#define INSN(encoding, format, cycles) cycles,
+#include "isa48.h"
+#undef INSN
+};
+
 #define MAX_OPS (((sizeof(Formats) / sizeof(Formats[0])) - 1) / PTRS_PER_FORMAT)
 
 typedef struct opcode {
@@ -152,6 +63,7 @@ typedef struct opcode {
 } M48Opcode;
 
 static M48Opcode Op[MAX_OPS+1];
+static int OpOf[256];	/* Op[] entry of each first byte, or -1. */
 static int OpInizialized = 0;
 
 static void InitDasm8039(void)
@@ -159,7 +71,7 @@ static void InitDasm8039(void)
 	const char *p, **ops;
 	byte mask, bits;
 	int bit;
-	int i;
+	int i, code;
 
 	ops = Formats; i = 0;
 	while (*ops) {
@@ -194,47 +106,120 @@ static void InitDasm8039(void)
 	i++;
 	}
 
+	for (code = 0; code < 256; code++) {
+		OpOf[code] = -1;
+		for (i = 0; i < MAX_OPS; i++) {
+			if ((code & Op[i].mask) != Op[i].bits)
+				continue;
+			if (OpOf[code] != -1)
+				fprintf(stderr, "Error: opcode %02X matches %d (%s) and %d (%s)\n",
+					code, i, Op[i].fmt, OpOf[code], Op[OpOf[code]].fmt);
+			OpOf[code] = i;
+		}
+	}
+
 	OpInizialized = 1;
 }
 
+/*
+ * Return the index of the opcode table entry matching the first
+ * byte of an instruction, or -1 if the byte isn't a valid opcode.
+ */
+int Match8039(int code)
+{
+	if (!OpInizialized) InitDasm8039();
+
+	return OpOf[code & 0xFF];
+}
+
+/*
+ * Return the format string of an opcode table entry.
+ */
+const char *Format8039(int op)
+{
+	return Op[op].fmt;
+}
+
+/*
+ * Return the length in bytes of instructions matching
+ * an opcode table entry.
+ */
+int Length8039(int op)
+{
+	return Op[op].extcode ? 2 : 1;
+}
+
+/*
+ * Return the machine cycles instructions matching an opcode
+ * table entry take.
+ */
+int Cycles8039(int op)
+{
+	return Cycles[op];
+}
+
 /*
  * DHH 1/23/03: Added these for use outside of MAME/MESS
  */
-static unsigned char *codebuf;
-static int cpu_readop(unsigned pc)
+static struct Dasm8039Context Context;	/* What Dasm8039() uses. */
+
+/*
+ * Set the code buffer Dasm8039() reads instructions from.
+ */
+void SetCode8039(unsigned char *buf)
 {
-	return codebuf[pc];
+	Context.code = buf;
 }
-static int cpu_readop_arg(unsigned pc)
+
+/*
+ * Set the names Dasm8039() prints for jump and call targets,
+ * indexed by address, or NULL for plain addresses.
+ */
+void SetLabels8039(const char **labels, unsigned size)
+{
+	Context.labels = labels;
+	Context.num_labels = size;
+}
+
+/*
+ * Set the names Dasm8039() prints for immediate values
+ * (256 entries), or NULL for plain values.
+ */
+void SetConstants8039(const char **constants)
+{
+	Context.constants = constants;
+}
+
+/*
+ * Print a jump or call target, by name if it has one.
+ */
+static void target_name(char *num, unsigned addr, const struct Dasm8039Context *ctx)
 {
-	return codebuf[pc];
+	if (ctx->labels != NULL && addr < ctx->num_labels && ctx->labels[addr] != NULL)
+		sprintf(num, "%.63s", ctx->labels[addr]);
+	else
+		sprintf(num, "$%04X", addr);
 }
 
 int Dasm8039(char *buffer, unsigned pc)
+{
+	return Dasm8039r(buffer, pc, &Context);
+}
+
+/*
+ * Disassemble the instruction at pc, with the code and names of
+ * ctx instead of those set for Dasm8039().  Returns its length.
+ */
+int Dasm8039r(char *buffer, unsigned pc, const struct Dasm8039Context *ctx)
 {
 	int b, a, d, r, p;	/* these can all be filled in by parsing an instruction */
-	int i;
 	int op;
 	int cnt = 1;
 	int code, bit;
 	const char *cp;
 
-	if (!OpInizialized) InitDasm8039();
-
-	code = cpu_readop(pc);
-	op = -1;	/* no matching opcode */
-	for ( i = 0; i < MAX_OPS; i++)
-	{
-		if( (code & Op[i].mask) == Op[i].bits )
-		{
-			if (op != -1)
-			{
-				fprintf(stderr, "Error: opcode %02X matches %d (%s) and %d (%s)\n",
-					code,i,Op[i].fmt,op,Op[op].fmt);
-			}
-			op = i;
-		}
-	}
+	code = ctx->code[pc];
+	op = Match8039(code);	/* -1 if no matching opcode */
 
 	if (op == -1)
 	{
@@ -246,7 +231,7 @@ int Dasm8039(char *buffer, unsigned pc)
 	{
 		cnt++;
 		code <<= 8;
-		code |= cpu_readop_arg((pc+1)&0xffff);
+		code |= ctx->code[(pc+1)&0xffff];
 		bit = 15;
 	}
 	else
@@ -281,15 +266,28 @@ int Dasm8039(char *buffer, unsigned pc)
 	{
 		if (*cp == '%')
 		{
-			char num[10], *q;
+			char num[64], *q;
 			cp++;
 			switch (*cp++)
 			{
-				case 'A': sprintf(num,"$%04X",a); break;
-				case 'J': sprintf(num,"$%04X",(pc & 0xf00) | a); break;
+				case 'A':
+					if (ctx->mb1 != NULL && pc < ctx->num_labels)
+						a |= ctx->mb1[pc] ? 0x800 : 0;
+					else
+						a |= pc & 0x800;
+					target_name(num, a, ctx);
+					break;
+				case 'J': target_name(num, ((pc+1) & 0xf00) | a, ctx); break;
 				case 'B': sprintf(num,"%d",b); break;
 				case 'D': sprintf(num,"%d",d); break;
-				case 'X': sprintf(num,"%X",d); break;
+				case 'X':
+					if (ctx->constants != NULL && ctx->constants[d] != NULL) {
+						if (buffer[-1] == '$')	/* drop the hex prefix */
+							buffer--;
+						sprintf(num, "%.63s", ctx->constants[d]);
+					} else
+						sprintf(num,"%X",d);
+					break;
 				case 'R': sprintf(num,"r%d",r); break;
 				case 'P': sprintf(num,"p%d",p + 4); break;
 				default:
@@ -309,54 +307,972 @@ int Dasm8039(char *buffer, unsigned pc)
 	return cnt;
 }
 
+#ifndef DASM8039_LIB
+
+#include <stdarg.h>
+#ifdef UNIXOID
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifndef HAVE_GETOPT
+extern int opterr, optind, optopt, optreset;
+extern char *optarg;
+int getopt(int nargc, char * const *nargv, const char *ostr);
+#endif
+
+/* ihex.c */
+extern int memory[];
+int load_hex(char *filename, int *minaddr, int *maxaddr);
+
+#define MAX_ENTRIES 256		/* Entry points given with -e. */
+#define MAX_THREADS 64		/* Threads for -j. */
+#define DB_PER_LINE 8		/* Bytes per .db line of data. */
+#define MIN_FILL 16		/* Repeated bytes printed as .org filler with -a. */
+#define MAX_DIFFS 16		/* Differences listed by -V. */
+#define OUT_CHUNK (1 << 16)	/* Output of a range grows by at least this much. */
+#define STDOUT_BUFFER (1 << 20)	/* Buffer for writing all output. */
+#define TO_END 0xFFFFFFFFu	/* Length of a range that goes to the end of the file. */
+
+/* What the traversal (-r) found at each address. */
+#define AT_DATA 0		/* Never reached: data, or dead code. */
+#define AT_CODE 1		/* First byte of an instruction. */
+#define AT_OPERAND 2		/* Second byte of an instruction. */
+#define AT_TABLE 3		/* Entry of the table after a jmpp @a. */
+
+/* How an address is referred to, for its label. */
+#define REF_NONE 0
+#define REF_JUMP 1
+#define REF_CALL 2
+
 /*
- * DHH 1/23/03: Added this driver for use outside of MAME/MESS.
+ * Memory banks a path may run with (-r), as bits: jmp and call take
+ * A11 from the bank selected with sel mb0/sel mb1, or 0 after an
+ * interrupt until retr, whatever bank is selected.
  */
-int main(int argc, char **argv)
-{
+#define MB_0 1
+#define MB_1 2
+#define MB_IRQ 4
+
+/* SEL MB0 and SEL MB1 opcodes. */
+#define SEL_MB0 0xE5
+#define SEL_MB1 0xF5
+
+/* A symbol read from an asm48 symbols file (-s). */
+struct Sym {
+	const char *name;
+	unsigned value;
+	int is_label;
+};
+
+/* An input file, mapped or read into memory. */
+struct Input {
 	const char *filename;
+	unsigned char *data;
+	unsigned size;
+	int mapped;
+};
+
+/*
+ * A range of an input to disassemble.  Its output is collected
+ * in memory, so ranges can be done by several threads and still
+ * be printed in the order given.
+ */
+struct Job {
+	struct Input *input;
 	unsigned offset, length;
+	const unsigned char *code;
+	unsigned char *kind, *ref;
+	unsigned char *bank;	/* MB_xxx bits each instruction was reached with (-r),
+				   then whether it runs with MB1 selected. */
+	const char **labels;	/* Name of each address, or NULL. */
+	unsigned *work;		/* Addresses still to follow (-r). */
+	unsigned num_work;
+	struct Dasm8039Context ctx;
+	char *out;
+	size_t out_len, out_size;
+	int failed;		/* Nonzero if -V found differences. */
+};
+
+static int recursive;		/* -r: follow the code. */
+static int reassemble;		/* -a: print source that asm48 assembles back. */
+static int verifying;		/* -V: check the -a source. */
+static int hex_input;		/* -H: all inputs are Intel hex. */
+static const char *assembler = "asm48";
+static unsigned entries[MAX_ENTRIES];
+static int num_entries;
+static const char *constants[256];	/* Name of each immediate value, or NULL. */
+static struct Sym *syms;	/* Symbols by value, labels first. */
+static unsigned num_syms;
+static struct Input *inputs;
+static int num_inputs;
+static struct Job *jobs;
+static int num_jobs, next_job;
+#ifdef UNIXOID
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void usage(void)
+{
+	const char *msg =
+		"Usage: 8039dasm [options] <filename> [<range>...] ...\n"
+		"A range is <start> <len> (as before), <start>:<len>, <start>-<end> or\n"
+		"<start> (to the end); without one the whole file is disassembled.\n"
+		"Numbers may be decimal or hex (0x...).\n"
+		"Options:\n"
+		"  -r               Follow the code from the entry points; the rest is data\n"
+		"  -e <address>     Another entry point for -r (besides 0, 3 and 7)\n"
+		"  -s <filename>    Name addresses and values from a symbols file of asm48 -s or -S\n"
+		"  -a               Print source that asm48 assembles back into the same bytes\n"
+		"  -V               Reassemble the -a output and compare it with the input\n"
+		"  -A <command>     Assembler run by -V (default asm48)\n"
+		"  -H               Read the inputs as Intel hex (default for .hex and .ihx)\n"
+		"  -j <threads>     Disassemble this many ranges at once (default: one per CPU)\n";
+
+	fprintf(stderr, "%s", msg);
+}
+
+/*
+ * Append to the output of a range.
+ */
+static void emit(struct Job *job, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(job->out + job->out_len, job->out_size - job->out_len, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && job->out_len + n < job->out_size)
+			break;
+		job->out_size += OUT_CHUNK + (n > 0 ? n : 0);
+		job->out = realloc(job->out, job->out_size);
+		if (job->out == NULL) {
+			fprintf(stderr, "Out of memory for the output of %s\n", job->input->filename);
+			exit(1);
+		}
+	}
+	job->out_len += n;
+}
+
+/*
+ * Order symbols by value, labels before constants, then by name.
+ */
+static int cmp_sym(const void *a, const void *b)
+{
+	const struct Sym *sa = a, *sb = b;
+
+	if (sa->value != sb->value)
+		return sa->value < sb->value ? -1 : 1;
+	if (sa->is_label != sb->is_label)
+		return sb->is_label - sa->is_label;
+	return strcmp(sa->name, sb->name);
+}
+
+/*
+ * Remember a symbol.
+ */
+static void add_sym(const char *name, unsigned long value, int is_label)
+{
+	static unsigned max_syms;
+
+	if (num_syms == max_syms) {
+		max_syms = max_syms ? 2 * max_syms : 256;
+		syms = realloc(syms, max_syms * sizeof(struct Sym));
+		if (syms == NULL) {
+			fprintf(stderr, "Out of memory reading symbols\n");
+			exit(1);
+		}
+	}
+	syms[num_syms].name = strdup(name);
+	syms[num_syms].value = (unsigned) value;
+	syms[num_syms].is_label = is_label;
+	num_syms++;
+}
+
+/*
+ * Index of the first symbol with a value, or of the first one
+ * above it.
+ */
+static unsigned find_sym(unsigned value)
+{
+	unsigned lo = 0, hi = num_syms, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (syms[mid].value < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Name the immediate values only one constant has.
+ */
+static void name_constants(void)
+{
+	unsigned i, j;
+
+	for (i = find_sym(0); i < num_syms && syms[i].value < 256; i = j) {
+		for (j = i; j < num_syms && syms[j].value == syms[i].value; j++)
+			;
+		while (i < j && syms[i].is_label)
+			i++;
+		if (j - i == 1)
+			constants[syms[i].value] = syms[i].name;
+	}
+}
+
+/*
+ * Name the addresses of a range that have labels, replacing any
+ * made up by -r.
+ */
+static void name_labels(struct Job *job)
+{
+	unsigned i;
+
+	for (i = 0; i < num_syms; i++) {
+		if (syms[i].is_label && syms[i].value < job->length
+				&& (i == 0 || syms[i - 1].value != syms[i].value))
+			job->labels[syms[i].value] = syms[i].name;
+	}
+}
+
+/*
+ * Print the labels at an address: all the symbols file has for
+ * it, or the one made up by -r.
+ */
+static void print_labels(struct Job *job, unsigned pc)
+{
+	unsigned i = find_sym(pc);
+
+	if (i < num_syms && syms[i].value == pc && syms[i].is_label) {
+		for (; i < num_syms && syms[i].value == pc && syms[i].is_label; i++)
+			emit(job, "%s:\n", syms[i].name);
+	} else if (job->labels[pc] != NULL)
+		emit(job, "%s:\n", job->labels[pc]);
+}
+
+/*
+ * Note how an address is referred to, and queue it for the
+ * traversal if it is reached with a bank it wasn't before.
+ */
+static void reach(struct Job *job, unsigned addr, int how, unsigned mb)
+{
+	if (addr >= job->length)
+		return;
+	if (job->ref[addr] < how)
+		job->ref[addr] = how;
+	if ((job->bank[addr] | mb) == job->bank[addr])
+		return;
+	job->bank[addr] |= mb;
+	job->work[job->num_work++] = addr;
+}
+
+/*
+ * Reach the target of the jmp or call at pc in each bank the path
+ * may have selected.
+ */
+static void reach_long(struct Job *job, unsigned pc, int how, unsigned mb)
+{
+	unsigned addr = ((job->code[pc] & 0xE0) << 3) | job->code[pc+1];
+
+	if (mb & (MB_0 | MB_IRQ))
+		reach(job, addr, how, mb & (MB_0 | MB_IRQ));
+	if (mb & MB_1)
+		reach(job, addr | 0x800, how, MB_1);
+}
+
+/*
+ * Read the table that usually follows a jmpp @a: page offsets of
+ * the code it dispatches to.  The table ends where the first of
+ * that code starts, or at a byte that can't be an entry.  It is
+ * read again when the jmpp is reached with another bank.
+ */
+static void jump_table(struct Job *job, unsigned t, unsigned mb)
+{
+	unsigned limit = (t | 0xFF) + 1, target;
+
+	for (; t < job->length && t < limit && (job->kind[t] == AT_DATA || job->kind[t] == AT_TABLE); t++) {
+		target = (t & 0xF00) | job->code[t];
+		if (target <= t)
+			break;
+		if (target < limit)
+			limit = target;
+		job->kind[t] = AT_TABLE;
+		reach(job, target, REF_JUMP, mb);
+	}
+}
+
+/*
+ * Follow the code from one address, with the banks it was reached
+ * with, until it jumps away, returns or runs into code already
+ * seen with those banks.  A call is taken to come back with the
+ * bank it was made with.
+ */
+static void trace(struct Job *job, unsigned pc)
+{
+	const unsigned char *code = job->code;
+	unsigned char *kind = job->kind;
+	unsigned mb = job->bank[pc], first = 1;
+	int op, n;
+
+	while (pc < job->length) {
+		if (kind[pc] == AT_DATA) {
+			op = Match8039(code[pc]);
+			if (op < 0)
+				return;
+			n = Length8039(op);
+			if (pc + n > job->length || (n == 2 && kind[pc+1] != AT_DATA))
+				return;
+			kind[pc] = AT_CODE;
+			if (n == 2)
+				kind[pc+1] = AT_OPERAND;
+		} else if (kind[pc] == AT_CODE && (first || (job->bank[pc] | mb) != job->bank[pc])) {
+			/* Seen before, but not with all of these banks. */
+			op = Match8039(code[pc]);
+			n = Length8039(op);
+		} else {
+			return;
+		}
+		first = 0;
+		mb |= job->bank[pc];
+		job->bank[pc] = mb;
+
+		if (n == 2 && (code[pc] & 0x1F) == 0x04) {	/* jmp */
+			reach_long(job, pc, REF_JUMP, mb);
+			return;
+		}
+		if (n == 2 && (code[pc] & 0x1F) == 0x14)	/* call */
+			reach_long(job, pc, REF_CALL, mb);
+		else if (n == 2 && strstr(Format8039(op), "%J") != NULL)
+			reach(job, ((pc+1) & 0xF00) | code[pc+1], REF_JUMP, mb);
+		else if (code[pc] == 0x83 || code[pc] == 0x93)	/* ret, retr */
+			return;
+		else if (code[pc] == 0xB3) {			/* jmpp @a */
+			jump_table(job, pc + 1, mb);
+			return;
+		} else if (code[pc] == SEL_MB0 && (mb & (MB_0 | MB_1)))
+			mb = (mb & MB_IRQ) | MB_0;
+		else if (code[pc] == SEL_MB1 && (mb & (MB_0 | MB_1)))
+			mb = (mb & MB_IRQ) | MB_1;
+		pc += n;
+	}
+}
+
+/*
+ * Find the code reached from the entry points, and make up
+ * labels for the places jumped to and called.
+ */
+static void find_code(struct Job *job)
+{
+	char name[16];
+	unsigned addr;
+	int i;
+
+	/* An address is queued each time it gains a bank: at most three times. */
+	job->ref = calloc(job->length, 1);
+	job->bank = calloc(job->length, 1);
+	job->work = malloc(3 * job->length * sizeof(unsigned));
+	if (job->ref == NULL || job->bank == NULL || job->work == NULL) {
+		fprintf(stderr, "Couldn't allocate tables for %u bytes\n", job->length);
+		exit(1);
+	}
+
+	job->num_work = 0;
+	reach(job, 0x000, REF_JUMP, MB_0);
+	reach(job, 0x003, REF_CALL, MB_IRQ);
+	reach(job, 0x007, REF_CALL, MB_IRQ);
+	for (i = 0; i < num_entries; i++)
+		reach(job, entries[i], REF_CALL, entries[i] & 0x800 ? MB_1 : MB_0);
+	while (job->num_work > 0)
+		trace(job, job->work[--job->num_work]);
+
+	for (addr = 0; addr < job->length; addr++) {
+		if (job->ref[addr] == REF_NONE || job->kind[addr] != AT_CODE)
+			continue;
+		sprintf(name, "%c%03X", job->ref[addr] == REF_CALL ? 'S' : 'L', addr);
+		job->labels[addr] = strdup(name);
+	}
+	for (addr = 0; addr < job->length; addr++) {
+		if (job->bank[addr] == MB_1)
+			job->bank[addr] = 1;
+		else if (job->bank[addr] & MB_1)
+			job->bank[addr] = (addr & 0x800) != 0;	/* Either bank. */
+		else
+			job->bank[addr] = 0;
+	}
+	free(job->ref);
+	free(job->work);
+}
+
+/*
+ * Find where each instruction starts when decoding from the first
+ * byte on, without following the code.
+ */
+static void find_linear(struct Job *job)
+{
+	unsigned pc = 0;
+	int op;
+
+	while (pc < job->length) {
+		op = Match8039(job->code[pc]);
+		if (op < 0 || pc + Length8039(op) > job->length) {
+			pc++;
+			continue;
+		}
+		job->kind[pc] = AT_CODE;
+		if (Length8039(op) == 2)
+			job->kind[pc + 1] = AT_OPERAND;
+		pc += Length8039(op);
+	}
+}
+
+/*
+ * Number of times the byte at pc repeats from there, up to end.
+ */
+static unsigned run_length(struct Job *job, unsigned pc, unsigned end)
+{
+	unsigned n;
+
+	for (n = 1; pc + n < end && job->code[pc + n] == job->code[pc]; n++)
+		;
+	return n;
+}
+
+/*
+ * Print the bytes from pc up to end as .db lines.  When the output
+ * is to be reassembled, long runs of one value become .org filler.
+ */
+static void print_data(struct Job *job, unsigned pc, unsigned end)
+{
+	unsigned n;
+
+	while (pc < end) {
+		if (reassemble && (n = run_length(job, pc, end)) >= MIN_FILL) {
+			emit(job, "\t.org  $%03X,$%02X\n", pc + n, job->code[pc]);
+			pc += n;
+			continue;
+		}
+		emit(job, "\t.db   ");
+		for (n = 0; pc < end && n < DB_PER_LINE; n++, pc++) {
+			if (reassemble && n > 0 && run_length(job, pc, end) >= MIN_FILL)
+				break;
+			emit(job, "%s$%02X", n > 0 ? "," : "", job->code[pc]);
+		}
+		emit(job, "\n");
+	}
+}
+
+/*
+ * Print the program as found by find_code(): code with labels,
+ * jump tables and the bytes never reached as .db.
+ */
+static void print_code(struct Job *job)
+{
 	char buf[256];
-	int pc = 0;
+	unsigned pc = 0, n, target, end;
+
+	while (pc < job->length) {
+		print_labels(job, pc);
+		if (job->kind[pc] == AT_CODE) {
+			pc += Dasm8039r(buf, pc, &job->ctx);
+			emit(job, "\t%s\n", buf);
+			continue;
+		}
+		if (job->kind[pc] == AT_TABLE) {
+			emit(job, "\t.jumptable ");
+			for (n = 0; pc < job->length && job->kind[pc] == AT_TABLE && n < DB_PER_LINE
+					&& (n == 0 || job->labels[pc] == NULL); n++, pc++) {
+				target = (pc & 0xF00) | job->code[pc];
+				if (job->labels[target] != NULL)
+					emit(job, "%s%s", n > 0 ? "," : "", job->labels[target]);
+				else
+					emit(job, "%s$%03X", n > 0 ? "," : "", target);
+			}
+			emit(job, "\n");
+			continue;
+		}
+		for (end = pc + 1; end < job->length && job->kind[end] == AT_DATA && job->labels[end] == NULL; end++)
+			;
+		print_data(job, pc, end);
+		pc = end;
+	}
+}
+
+/*
+ * Print every byte as an instruction, one after the other.  An
+ * instruction cut off at the end is printed as .db, and so are
+ * undefined opcodes when the output is to be reassembled.
+ */
+static void print_linear(struct Job *job)
+{
+	char buf[256];
+	unsigned pc = 0;
+
+	while (pc < job->length) {
+		print_labels(job, pc);
+		if (job->kind[pc] != AT_CODE && (reassemble || Match8039(job->code[pc]) >= 0)) {
+			emit(job, reassemble ? "\t.db   $%02X\n" : ".db   $%02X\n", job->code[pc]);
+			pc++;
+			continue;
+		}
+		pc += Dasm8039r(buf, pc, &job->ctx);
+		emit(job, reassemble ? "\t%s\n" : "%s\n", buf);
+	}
+}
+
+/*
+ * Disassemble a range.  Source to be reassembled starts with the
+ * names that have no place of their own in it: immediate values,
+ * and labels inside an instruction.
+ */
+static void disassemble(struct Job *job)
+{
+	unsigned i;
+
+	if (reassemble || num_jobs > 1)
+		emit(job, "; %s, %u bytes from offset %u\n", job->input->filename, job->length, job->offset);
+	if (reassemble) {
+		for (i = 0; i < 256; i++) {
+			if (constants[i] != NULL)
+				emit(job, "\t.equ  %s, $%02X\n", constants[i], i);
+		}
+		for (i = 0; i < job->length; i++) {
+			if (job->labels[i] != NULL && job->kind[i] == AT_OPERAND)
+				emit(job, "\t.equ  %s, $%03X\n", job->labels[i], i);
+		}
+	}
+	if (recursive)
+		print_code(job);
+	else
+		print_linear(job);
+}
+
+/*
+ * Write the disassembly of a range to a source file, assemble
+ * that with asm48 and compare the image with the range byte for
+ * byte (-V).  The output of the range is replaced by the result.
+ */
+static void verify(struct Job *job)
+{
+	const char *filename = job->input->filename;
+	char src[FILENAME_MAX], bin[FILENAME_MAX], cmd[3 * FILENAME_MAX];
+	unsigned char *image;
+	unsigned size, addr, diffs = 0;
 	FILE *fp;
 
-	if (argc != 4) {
-		fprintf(stderr, "Usage: 8039dasm <filename> <offset> <len>\n");
+	if (job->offset == 0) {
+		sprintf(src, "%.*s.v.asm", FILENAME_MAX - 16, filename);
+		sprintf(bin, "%.*s.v.bin", FILENAME_MAX - 16, filename);
+	} else {
+		sprintf(src, "%.*s.%X.v.asm", FILENAME_MAX - 24, filename, job->offset);
+		sprintf(bin, "%.*s.%X.v.bin", FILENAME_MAX - 24, filename, job->offset);
+	}
+	fp = fopen(src, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "Couldn't open %s for output: %s\n", src, strerror(errno));
 		exit(1);
 	}
+	fwrite(job->out, 1, job->out_len, fp);
+	fclose(fp);
+	job->out_len = 0;
+	job->failed = 1;
+
+	sprintf(cmd, "%s -o \"%s\" \"%s\"", assembler, bin, src);
+	if (system(cmd) != 0) {
+		emit(job, "Couldn't reassemble %s with %s\n", src, assembler);
+		return;
+	}
+
+	image = malloc(job->length + 1);
+	fp = fopen(bin, "rb");
+	if (image == NULL || fp == NULL) {
+		emit(job, "Couldn't read %s\n", bin);
+		free(image);
+		return;
+	}
+	size = fread(image, 1, job->length + 1, fp);
+	fclose(fp);
+
+	if (size != job->length) {
+		emit(job, "Reassembled image of %s is %u bytes instead of %u\n", src, size, job->length);
+		diffs++;
+	}
+	for (addr = 0; addr < size && addr < job->length; addr++) {
+		if (image[addr] != job->code[addr] && diffs++ < MAX_DIFFS)
+			emit(job, "%04X: %02X instead of %02X\n", addr, image[addr], job->code[addr]);
+	}
+	free(image);
+	if (diffs > 0) {
+		emit(job, "%u differences, see %s\n", diffs, src);
+		return;
+	}
+	emit(job, "%s: %u bytes reassembled identically\n", src, job->length);
+	job->failed = 0;
+	remove(src);
+	remove(bin);
+}
+
+/*
+ * Disassemble one range into its output buffer.
+ */
+static void run_job(struct Job *job)
+{
+	job->kind = calloc(job->length, 1);
+	job->labels = calloc(job->length, sizeof(char *));
+	job->out_size = OUT_CHUNK;
+	job->out = malloc(job->out_size);
+	if (job->kind == NULL || job->labels == NULL || job->out == NULL) {
+		fprintf(stderr, "Couldn't allocate tables for %u bytes\n", job->length);
+		exit(1);
+	}
+	job->out_len = 0;
+	job->out[0] = '\0';
+
+	if (recursive)
+		find_code(job);
+	else
+		find_linear(job);
+	name_labels(job);
+	job->ctx.code = job->code;
+	job->ctx.labels = job->labels;
+	job->ctx.num_labels = job->length;
+	job->ctx.constants = constants;
+	job->ctx.mb1 = recursive ? job->bank : NULL;
+
+	disassemble(job);
+	if (verifying)
+		verify(job);
+	free(job->kind);
+	free(job->labels);
+	if (recursive)
+		free(job->bank);
+}
+
+/*
+ * The next range nobody is working on, or NULL.
+ */
+static struct Job *take_job(void)
+{
+	struct Job *job = NULL;
+
+#ifdef UNIXOID
+	pthread_mutex_lock(&job_lock);
+#endif
+	if (next_job < num_jobs)
+		job = &jobs[next_job++];
+#ifdef UNIXOID
+	pthread_mutex_unlock(&job_lock);
+#endif
+	return job;
+}
+
+static void *worker(void *arg)
+{
+	struct Job *job;
+
+	while ((job = take_job()) != NULL)
+		run_job(job);
+	return arg;
+}
+
+/*
+ * Disassemble all ranges, with up to num_threads threads.
+ */
+static void run_jobs(int num_threads)
+{
+#ifdef UNIXOID
+	pthread_t threads[MAX_THREADS];
+	int i, started = 0;
+
+	if (num_threads > num_jobs)
+		num_threads = num_jobs;
+	for (i = 0; i < num_threads && num_threads > 1; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL) == 0)
+			started++;
+	}
+	worker(NULL);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+#else
+	worker(NULL);
+#endif
+}
 
-	filename = argv[1];
-	offset = (unsigned) atoi(argv[2]);
-	length = (unsigned) atoi(argv[3]);
+/*
+ * Is a file Intel hex, going by -H and its name?
+ */
+static int is_hex_file(const char *filename)
+{
+	const char *ext = strrchr(filename, '.');
+
+	if (hex_input)
+		return 1;
+	if (ext == NULL)
+		return 0;
+	ext++;
+	return (tolower(ext[0]) == 'h' && tolower(ext[1]) == 'e' && tolower(ext[2]) == 'x' && ext[3] == '\0')
+		|| (tolower(ext[0]) == 'i' && tolower(ext[1]) == 'h' && tolower(ext[2]) == 'x' && ext[3] == '\0');
+}
 
-	fp = fopen(filename, "rb");
+/*
+ * Bring an input file into memory: Intel hex through ihex.c,
+ * from address 0 up to the highest byte it sets; binary files
+ * are mapped where possible and read otherwise.
+ */
+static void load_input(struct Input *in)
+{
+	int min, max, i;
+	long size;
+	FILE *fp;
+#ifdef UNIXOID
+	struct stat st;
+	int fd;
+#endif
+
+	if (is_hex_file(in->filename)) {
+		memset(memory, 0, 65536 * sizeof(int));
+		if (load_hex((char *) in->filename, &min, &max) < 0) {
+			fprintf(stderr, "Couldn't read Intel hex file %s\n", in->filename);
+			exit(1);
+		}
+		in->size = max >= min ? max + 1 : 0;
+		in->data = malloc(in->size + 1);
+		if (in->data == NULL) {
+			fprintf(stderr, "Couldn't malloc %u bytes: %s\n", in->size, strerror(errno));
+			exit(1);
+		}
+		for (i = 0; i < (int) in->size; i++)
+			in->data[i] = memory[i];
+		return;
+	}
+
+#ifdef UNIXOID
+	fd = open(in->filename, O_RDONLY);
+	if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+		in->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (in->data != MAP_FAILED) {
+			in->size = st.st_size;
+			in->mapped = 1;
+			close(fd);
+			return;
+		}
+	}
+	if (fd >= 0)
+		close(fd);
+#endif
+
+	fp = fopen(in->filename, "rb");
 	if (fp == NULL) {
-		fprintf(stderr, "Couldn't open %s: %s\n", filename, strerror(errno));
+		fprintf(stderr, "Couldn't open %s: %s\n", in->filename, strerror(errno));
+		exit(1);
+	}
+	if (fseek(fp, 0, SEEK_END) < 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) < 0) {
+		fprintf(stderr, "Couldn't find the size of %s: %s\n", in->filename, strerror(errno));
+		exit(1);
+	}
+	in->size = size;
+	in->data = malloc(in->size + 1);
+	if (in->data == NULL) {
+		fprintf(stderr, "Couldn't malloc %u bytes: %s\n", in->size, strerror(errno));
 		exit(1);
 	}
+	if (fread(in->data, 1, in->size, fp) != in->size) {
+		fprintf(stderr, "Couldn't read %u bytes from %s: %s\n", in->size, in->filename, strerror(errno));
+		exit(1);
+	}
+	fclose(fp);
+}
 
-	if (fseek(fp, offset, SEEK_SET) < 0) {
-		fprintf(stderr, "Couldn't seek to %u in %s: %s\n", offset, filename, strerror(errno));
+/*
+ * Parse a range: "START", "START:LEN" or "START-END".  Returns 0
+ * if arg isn't one, so that it is taken as a file name.
+ */
+static int parse_range(const char *arg, unsigned *start, unsigned *len, int *has_len)
+{
+	unsigned long a, b;
+	char *end, sep;
+
+	if (!isdigit((unsigned char) arg[0]))
+		return 0;
+	a = strtoul(arg, &end, 0);
+	*start = (unsigned) a;
+	*has_len = 0;
+	if (*end == '\0')
+		return 1;
+	sep = *end;
+	if ((sep != ':' && sep != '-') || !isdigit((unsigned char) end[1]))
+		return 0;
+	b = strtoul(end + 1, &end, 0);
+	if (*end != '\0' || (sep == '-' && b < a))
+		return 0;
+	*len = (unsigned) (sep == ':' ? b : b - a + 1);
+	*has_len = 1;
+	return 1;
+}
+
+/*
+ * Add a range of the last input.
+ */
+static void add_job(unsigned offset, unsigned length)
+{
+	jobs = realloc(jobs, (num_jobs + 1) * sizeof(struct Job));
+	if (jobs == NULL) {
+		fprintf(stderr, "Out of memory\n");
 		exit(1);
 	}
+	memset(&jobs[num_jobs], 0, sizeof(struct Job));
+	jobs[num_jobs].input = &inputs[num_inputs - 1];
+	jobs[num_jobs].offset = offset;
+	jobs[num_jobs].length = length;
+	num_jobs++;
+}
 
-	codebuf = (unsigned char *) malloc(length);
-	if (codebuf == NULL) {
-		fprintf(stderr, "Couldn't malloc %u bytes: %s\n", length, strerror(errno));
+/*
+ * Read the file and range arguments.  Two numbers in a row are
+ * an offset and a length, as in "8039dasm rom.bin 0 4096".
+ */
+static void parse_inputs(int argc, char **argv)
+{
+	unsigned start, len, pending = 0;
+	int i, has_len, has_pending = 0, first_job = 0;
+
+	inputs = calloc(argc, sizeof(struct Input));
+	if (inputs == NULL) {
+		fprintf(stderr, "Out of memory\n");
 		exit(1);
 	}
+	for (i = 0; i <= argc; i++) {
+		if (i < argc && num_inputs > 0 && parse_range(argv[i], &start, &len, &has_len)) {
+			if (has_pending) {
+				add_job(pending, has_len ? TO_END : start);
+				has_pending = 0;
+				if (!has_len)
+					continue;
+			}
+			if (has_len)
+				add_job(start, len);
+			else {
+				pending = start;
+				has_pending = 1;
+			}
+			continue;
+		}
+		if (has_pending)
+			add_job(pending, TO_END);
+		else if (num_inputs > 0 && num_jobs == first_job)
+			add_job(0, TO_END);
+		has_pending = 0;
+		if (i == argc)
+			break;
+		inputs[num_inputs++].filename = argv[i];
+		first_job = num_jobs;
+	}
+}
+
+/*
+ * DHH 1/23/03: Added this driver for use outside of MAME/MESS.
+ */
+int main(int argc, char **argv)
+{
+	const char *symbols_file = NULL;
+	struct Job *job;
+	int opt, i, num_threads = 1, failed = 0;
 
-	if (fread(codebuf, 1, length, fp) != length) {
-		fprintf(stderr, "Couldn't read %u bytes from %s: %s\n", length, filename, strerror(errno));
+	setvbuf(stdout, NULL, _IOFBF, STDOUT_BUFFER);
+#ifdef UNIXOID
+	num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	opterr = 0;
+	while ((opt = getopt(argc, argv, "raVHA:e:s:j:")) != -1) {
+		switch (opt) {
+			case 'r':
+				recursive = 1;
+				break;
+			case 'a':
+				reassemble = 1;
+				break;
+			case 'V':
+				verifying = 1;
+				reassemble = 1;
+				break;
+			case 'H':
+				hex_input = 1;
+				break;
+			case 'A':
+				assembler = optarg;
+				break;
+			case 's':
+				symbols_file = optarg;
+				break;
+			case 'j':
+				num_threads = atoi(optarg);
+				break;
+			case 'e':
+				if (num_entries == MAX_ENTRIES) {
+					fprintf(stderr, "Too many entry points\n");
+					exit(1);
+				}
+				entries[num_entries++] = (unsigned) strtoul(optarg, NULL, 0);
+				break;
+			case '?':
+				fprintf(stderr, "Unknown option '%c'\n", optopt);
+				usage();
+				exit(1);
+		}
+	}
+	if (optind >= argc) {
+		usage();
 		exit(1);
 	}
+	if (num_threads < 1)
+		num_threads = 1;
+	if (num_threads > MAX_THREADS)
+		num_threads = MAX_THREADS;
 
-	InitDasm8039();
+	parse_inputs(argc - optind, argv + optind);
+	for (i = 0; i < num_inputs; i++)
+		load_input(&inputs[i]);
+	for (i = 0; i < num_jobs; i++) {
+		job = &jobs[i];
+		if (job->length == TO_END)
+			job->length = job->offset < job->input->size ? job->input->size - job->offset : 0;
+		if (job->offset > job->input->size || job->length > job->input->size - job->offset) {
+			fprintf(stderr, "Couldn't read %u bytes from %s at %u: the file has %u bytes\n",
+				job->length, job->input->filename, job->offset, job->input->size);
+			exit(1);
+		}
+		job->code = job->input->data + job->offset;
+	}
 
-	while (pc < length) {
-		pc += Dasm8039(buf, pc);
-		printf("%s\n", buf);
+	InitDasm8039();
+	if (symbols_file != NULL) {
+		read_symbols(symbols_file, add_sym);
+		qsort(syms, num_syms, sizeof(struct Sym), &cmp_sym);
+		name_constants();
 	}
 
-	return 0;
+	run_jobs(num_threads);
+
+	for (i = 0; i < num_jobs; i++) {
+		fwrite(jobs[i].out, 1, jobs[i].out_len, stdout);
+		failed |= jobs[i].failed;
+		free(jobs[i].out);
+	}
+	fflush(stdout);
+#ifdef UNIXOID
+	for (i = 0; i < num_inputs; i++) {
+		if (inputs[i].mapped)
+			munmap(inputs[i].data, inputs[i].size);
+	}
+#endif
+	return failed;
 }
+#endif /* DASM8039_LIB */
@@ -0,0 +1,37 @@
+/*
+ * mcs48 disassembler interface, for programs other than 8039dasm
+ * that use its opcode table (compile 8039dasm.c with -DDASM8039_LIB).
+ */
+
+#ifndef DASM8039_H
+#define DASM8039_H
+
+/*
+ * What Dasm8039r() decodes, and the names it prints for jump
+ * and call targets (by address) and immediate values (256
+ * entries); either may be NULL.  mb1 (num_labels entries) is
+ * nonzero where a jmp or call runs with MB1 selected; if NULL,
+ * they jump within the bank they are in.
+ */
+struct Dasm8039Context {
+	const unsigned char *code;
+	const char **labels;
+	unsigned num_labels;
+	const char **constants;
+	const unsigned char *mb1;
+};
+
+int Match8039(int code);
+const char *Format8039(int op);
+int Length8039(int op);
+int Cycles8039(int op);
+void SetCode8039(unsigned char *buf);
+void SetLabels8039(const char **labels, unsigned size);
+void SetConstants8039(const char **constants);
+int Dasm8039(char *buffer, unsigned pc);
+int Dasm8039r(char *buffer, unsigned pc, const struct Dasm8039Context *ctx);
+
+/* symfile.c: asm48 symbols files, for 8039dasm and sim48. */
+void read_symbols(const char *filename, void (*add)(const char *name, unsigned long value, int is_label));
+
+#endif /* DASM8039_H */
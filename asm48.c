@@ -42,9 +42,6 @@ extern char *optarg;
 int getopt(int nargc, char * const *nargv, const char *ostr);
 #endif
 
-/* The list of generated instructions. */
-struct Instruction *ins_head, *ins_tail;
-
 /* Memory pool for internal objects. */
 struct Pool *gen_pool;
 
@@ -57,6 +54,33 @@ int cur_offset;
 /* Filename of currently source being assembled. */
 char *cur_file;
 
+/* Nonzero when writing a relocatable object file (-c). */
+int object_mode = 0;
+
+/* Nonzero when jumps out of their page are errors (link step). */
+int strict_pages = 0;
+
+/* Nonzero when out-of-page conditional jumps are rewritten (-r). */
+int relax_branches = 0;
+
+/* Nonzero when the peephole optimizer runs (-O). */
+static int optimize_code = 0;
+
+/* Nonzero when unreachable code and data are removed (-u). */
+static int strip_unused = 0;
+
+/* Nonzero when identical data blocks are merged (-d). */
+static int merge_blocks = 0;
+
+/* Nonzero when SEL MB0/MB1 are added where jmp and call need them (-m). */
+int select_banks = 0;
+
+/* Layout passes before -m stops adding SELs. */
+#define MAX_BANK_PASSES 16
+
+/* Nonzero when linking object files (-l). */
+static int link_mode = 0;
+
 /* Bank usage */
 int bank_display = 0;
 int bank_usage[BANK_USAGE_MAX];
@@ -79,10 +103,16 @@ void cur_file_set(const char *filename)
  */
 static void assemble(void)
 {
-	struct Instruction *cur = ins_head;
-	while (cur != NULL) {
-		cur->vtable->assemble(cur);
-		cur = cur->next;
+	struct Section *sect;
+	struct Instruction *cur;
+
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		for (cur = sect->head; cur != NULL; cur = cur->next) {
+			/* Leave operands that refer to other modules to the linker. */
+			if (object_mode && is_fixup(cur))
+				continue;
+			cur->vtable->assemble(cur);
+		}
 	}
 }
 
@@ -93,12 +123,29 @@ static void usage(void)
 {
 	const char *msg =
 		"Usage: asm48 [options] <input file>\n"
+		"       asm48 -l [options] <object files...>\n"
 		"Options:\n"
 		"  -v               Print version number only and exit\n"
 		"  -t               Print ROM bank usage table\n"
+		"  -c               Assemble into a relocatable object file (.o48)\n"
+		"  -l               Link object files into an image\n"
+		"  -r               Rewrite conditional jumps whose target is out of page\n"
+		"  -m               Add SEL MB0/MB1 where a jmp or call needs another bank\n"
+		"  -O               Optimize the code with a peephole pass\n"
+		"  -d               Merge data blocks repeated in the same page\n"
+		"  -u               Remove code and data not reached from the vectors or exports\n"
 		"  -s <filename>    Export symbols list\n"
+		"  -S <filename>    Export symbols list in compact binary form\n"
+		"  -i <filename>    Import read-only symbols from a list written by -s or -S\n"
 		"  -o <filename>    Specify the name of the output file\n"
-		"  -f (bin|hex)     Specify output format (binary or Intel hex; default bin)\n";
+		"  -f (bin|hex)     Specify output format (binary or Intel hex; default bin)\n"
+		"  -e <count>       Stop after this many errors (default 20, 0 = no limit)\n"
+		"  -j <filename>    Write errors and warnings to a file in JSON form\n"
+		"  -T <filename>    Write a report of best and worst case cycles per routine\n"
+		"  -G <filename>    Write the call graph with cycle counts in DOT form\n"
+		"  -P <from>,<to>   Add the cycles between two labels to the timing report\n"
+		"  -M <bytes>       Size of internal RAM for .ram: 64, 128 or 256 (default 64)\n"
+		"  -R <filename>    Write the addresses given to .ram variables, by routine\n";
 
 	fprintf(stderr, "%s", msg);
 }
@@ -108,16 +155,19 @@ static void usage(void)
  */
 static void output_bin(const char *filename)
 {
+	int size;
+	unsigned char *image = build_image(&size);
 	FILE *fp = fopen(filename, "wb");
 	if (fp == NULL)
 		err_printf("Couldn't open %s for output: %s\n", filename, strerror(errno));
 
-	if (fwrite(asm_pool->buf, 1, cur_offset, fp) != cur_offset)
-		err_printf("Failed to write %d bytes of output to %s: %s\n", cur_offset, filename, strerror(errno));
+	if (fwrite(image, 1, size, fp) != size)
+		err_printf("Failed to write %d bytes of output to %s: %s\n", size, filename, strerror(errno));
 
-	printf("   Assembled %d bytes.\n", cur_offset);
+	printf("   Assembled %d bytes.\n", size);
 
 	fclose(fp);
+	free(image);
 }
 
 /*
@@ -126,20 +176,27 @@ static void output_bin(const char *filename)
 static void output_hex(const char *filename)
 {
 	extern int memory[];
-	unsigned char *ptr = (unsigned char *) asm_pool->buf;
-	int i;
+	int i, size;
+	unsigned char *image = build_image(&size);
 	char cmd_str[256];
 
-	for (i = 0; i < cur_offset; ++i)
-		memory[i] = *ptr++;
+	if (size > 65536)
+		err_printf("Image of %d bytes is too large for Intel hex output\n", size);
+	for (i = 0; i < size; ++i)
+		memory[i] = image[i];
 
-	sprintf(cmd_str, "S 0 %x %s", cur_offset - 1, filename);
+	sprintf(cmd_str, "S 0 %x %s", size - 1, filename);
 	save_file(cmd_str);
+	free(image);
 }
 
-/* Name of input file. */
+/* Name of input file (the first object file when linking). */
 static const char *input_file;
 
+/* All input files, and their number. */
+static char **input_files;
+static int num_inputs;
+
 /* Name of output file. */
 static char *output_file = NULL;
 
@@ -152,6 +209,22 @@ static const char *output_suffix = ".bin";
 /* Name of symbols file. */
 static char *symbols_file = NULL;
 
+/* Name of binary symbols file. */
+static char *symbols_bin_file = NULL;
+
+/* Symbols files to import. */
+#define MAX_IMPORTS 16
+static char *import_files[MAX_IMPORTS];
+static int num_imports = 0;
+
+/* Timing report, call graph and number of -P timing paths. */
+static char *timing_file = NULL;
+static char *graph_file = NULL;
+static int num_timing_paths = 0;
+
+/* RAM map written by -R. */
+static char *ram_map_file = NULL;
+
 /*
  * Parse command line options.
  */
@@ -161,16 +234,47 @@ static void parse_options(int argc, char **argv)
 
 	opterr = 0;
 
-	while ((opt = getopt(argc, argv, "vts:o:f:")) != -1) {
+	while ((opt = getopt(argc, argv, "vtclrmOdus:S:i:o:f:e:j:T:G:P:M:R:")) != -1) {
 		switch (opt) {
 			case 'v':
 				exit(0);
 			case 't':
 				bank_display = 1;
 				break;
+			case 'c':
+				object_mode = 1;
+				break;
+			case 'l':
+				link_mode = 1;
+				break;
+			case 'r':
+				relax_branches = 1;
+				break;
+			case 'm':
+				select_banks = 1;
+				break;
+			case 'O':
+				optimize_code = 1;
+				break;
+			case 'd':
+				merge_blocks = 1;
+				break;
+			case 'u':
+				strip_unused = 1;
+				break;
 			case 's':
 				symbols_file = optarg;
 				break;
+			case 'S':
+				symbols_bin_file = optarg;
+				break;
+			case 'i':
+				if (num_imports >= MAX_IMPORTS) {
+					fprintf(stderr, "Too many symbols files to import\n");
+					exit(1);
+				}
+				import_files[num_imports++] = optarg;
+				break;
 			case 'o':
 				output_file = optarg;
 				break;
@@ -187,6 +291,30 @@ static void parse_options(int argc, char **argv)
 					exit(1);
 				}
 				break;
+			case 'e':
+				error_limit = atoi(optarg);
+				break;
+			case 'j':
+				diag_file = optarg;
+				break;
+			case 'T':
+				timing_file = optarg;
+				break;
+			case 'G':
+				graph_file = optarg;
+				break;
+			case 'M':
+				ram_size = atoi(optarg);
+				if (ram_size != 64 && ram_size != 128 && ram_size != 256)
+					err_printf("RAM size must be 64, 128 or 256\n");
+				break;
+			case 'R':
+				ram_map_file = optarg;
+				break;
+			case 'P':
+				add_timing_path(optarg);
+				num_timing_paths++;
+				break;
 			case '?':
 				fprintf(stderr, "Unknown option '%c'\n", optopt);
 				usage();
@@ -196,13 +324,23 @@ static void parse_options(int argc, char **argv)
 
 	/*
 	 * The last command line argument should be
-	 * the input file.
+	 * the input file.  When linking, all remaining
+	 * arguments are object files.
 	 */
-	if (optind != argc - 1) {
+	if (object_mode && link_mode) {
+		fprintf(stderr, "Options -c and -l can't be combined\n");
+		usage();
+		exit(1);
+	}
+	if (link_mode ? optind >= argc : optind != argc - 1) {
 		usage();
 		exit(1);
 	}
 	input_file = argv[optind];
+	input_files = argv + optind;
+	num_inputs = argc - optind;
+	if (object_mode)
+		output_suffix = ".o48";
 
 	/*
 	 * If no output file was specified, transform the name of the input file,
@@ -231,38 +369,100 @@ static void parse_options(int argc, char **argv)
  */
 int main(int argc, char **argv)
 {
-	extern FILE *yyin;
+	extern int lex_open(const char *filename);
 	extern void yyparse(void);
-	int i;
+	int i, banked, rom, used, page;
 
 	fprintf(stderr, "*** asm48 v" VERSION " ***\n");
 	parse_options(argc, argv);
 
-	yyin = fopen(input_file, "r");
-	if (yyin == NULL) {
-		err_printf("Couldn't open input file %s: %s\n", input_file, strerror(errno));
-		exit(1);
-	}
-
 	memset(bank_usage, 0, sizeof(bank_usage));
 	gen_pool = create_pool(GEN_POOL_SIZE);
 	asm_pool = create_pool(ASM_POOL_SIZE);
+	cur_section = create_section(ABS_SECTION, 0);
+
+	for (i = 0; i < num_imports; i++)
+		import_symbols(import_files[i]);
+
+	if (link_mode) {
+		strict_pages = 1;
+		for (i = 0; i < num_inputs; i++)
+			read_object(input_files[i]);
+	} else {
+		if (lex_open(input_file) < 0) {
+			err_printf("Couldn't open input file %s: %s\n", input_file, strerror(errno));
+			exit(1);
+		}
+
+		cur_file_set(input_file);
+		yyparse();
+		resolve_exports();
+	}
+
+	if (object_mode) {
+		layout();
+		assemble();
+		check_errors();
+		write_object(output_file);
+		finish_diagnostics();
+		return 0;
+	}
 
-	cur_file_set(input_file);
-	yyparse();
+	place_sections();
+	layout();
+	if (strip_unused) {
+		strip_unreachable();
+		place_sections();
+		layout();
+	}
+	if (merge_blocks) {
+		merge_data();
+		place_sections();
+		layout();
+	}
+	if (optimize_code)
+		optimize();
+	for (i = 0; select_banks && i < MAX_BANK_PASSES && insert_bank_selects() > 0; i++) {
+		place_sections();
+		layout();
+	}
+	allocate_ram(ram_map_file);
 	assemble();
+	check_banks();
+	compute_bank_usage();
+	check_cycles();
+	check_errors();
+	if (timing_file || graph_file || num_timing_paths) {
+		/* Only for a program that assembled; a bad -P point is an error too. */
+		write_timing(timing_file, graph_file);
+		check_errors();
+	}
 	if (symbols_file) export_symbols(symbols_file);
+	if (symbols_bin_file) export_symbols_bin(symbols_bin_file);
 	output_func(output_file);
 
 	if (bank_display) {
 		printf("\n   ROM banks usage:\n");
+		for (i=MAX_ADDR / 256; i<BANK_USAGE_MAX && !bank_usage[i]; i++)
+			;
+		banked = i < BANK_USAGE_MAX;
 		for (i=0; i<BANK_USAGE_MAX; i++) {
+			if (banked && i % (MAX_ADDR / 256) == 0) {
+				rom = i / (MAX_ADDR / 256);
+				for (used = 0, page = i; page < i + MAX_ADDR / 256; page++)
+					used += bank_usage[page];
+				if (used)
+					printf(" ROM bank %d at file offset %05X, %4d occupied, %4d free\n",
+					 rom, rom_file_offset(rom * MAX_ADDR), used, MAX_ADDR - used);
+			}
 			if (bank_usage[i]) {
 				printf(" bank%3d, %4d occupied, %4d free, %3d%% usage\n",
-				 i, bank_usage[i], 256 - bank_usage[i], bank_usage[i] * 100 / 256);
+				 banked ? i % (MAX_ADDR / 256) : i, bank_usage[i], 256 - bank_usage[i], bank_usage[i] * 100 / 256);
 			}
 		}
+		report_free_space();
 	}
 
+	finish_diagnostics();
 	return 0;
 }
@@ -39,6 +39,11 @@
 
 #define PAGE_MASK (~(0xFF))	/* Mask for 256 byte "page" in instruction memory. */
 #define MAX_ADDR (1<<12)	/* Maximum address for call and jmp instructions. */
+#define BANK_SIZE (1<<11)	/* Size of a memory bank (MB0/MB1); code can't run across one. */
+#define MAX_ROM_BANKS 16	/* Logical ROM banks (.bank), each with its own MAX_ADDR addresses. */
+#define ROM_ADDR(offset) ((offset) & (MAX_ADDR - 1))	/* Address of an offset within its ROM bank. */
+
+#define ABS_SECTION "abs"	/* Name of the default (absolute) section. */
 
 /*
  * Memory pool object, for quick allocation.
@@ -57,11 +62,15 @@ struct Expr {
 	const char *sym;
 	int value;
 	int line_num;
+	int column;
 	int cur_offset;
 	int mustexist;
+	struct Instruction *mark;	/* Position marker for .here and linked labels. */
 };
 
 struct Vtable;
+struct Symbol;
+struct Section;
 
 /*
  * Instruction - represents either a single assembly instruction,
@@ -69,14 +78,33 @@ struct Vtable;
  */
 struct Instruction {
 	struct Vtable *vtable;
+	int type;
 	int offset, size;
 	int src_line;
 	unsigned char *buf;
 	struct Expr *expr;
+	int value;		/* INS_FILL: target offset; INS_LABEL: marker id;
+				   INS_CODE: nonzero for a branch added by relaxation. */
+	int loop_min, loop_max;	/* .loop bounds of a backward branch, loop_max < 0 if none. */
+	struct Symbol *sym;	/* INS_LABEL: label defined here (NULL for .here). */
+	struct Section *section;
 	char *cur_file;
 	struct Instruction *next;
 };
 
+/* Instruction types. */
+#define INS_CODE	0	/* Machine instruction. */
+#define INS_DATA	1	/* Data bytes (.db, .dw, .incbin, ...). */
+#define INS_FILL	2	/* .org filler, buf[0] holds the fill byte. */
+#define INS_LABEL	3	/* Zero-sized position marker. */
+
+/* Compression methods for .incbin_rle and .incbin_lz. */
+#define PACK_RLE	0
+#define PACK_LZ		1
+#define PACK_BOUND(size) ((size) + (size) / 0x7F + 2)	/* Worst case packed size. */
+#define MAX_PACKED	256	/* Packed data is read within one page... */
+#define MAX_UNPACKED	256	/* ...and unpacked through an 8-bit pointer. */
+
 /*
  * Virtual methods for Instruction objects.
  */
@@ -91,14 +119,105 @@ struct Symbol {
 	const char *name;
 	int value;
 	int type;
+	int flags;
+	struct Instruction *ins;	/* Label marker, NULL for constants. */
+	struct Expr *expr;		/* Value of a constant that refers to labels, or NULL. */
 	struct Symbol *next;
+	struct Symbol *hash_next;
+};
+
+/*
+ * Section - a run of instructions placed as one unit.
+ * The default section is absolute and is positioned with .org;
+ * sections opened with .section are relocatable and get their
+ * base address when sections are placed (or at link time).
+ */
+struct Section {
+	const char *name;
+	int reloc;
+	int base, size;
+	int end;		/* Parse-time offset of the next instruction. */
+	int in_page;		/* Nonzero if it must fit in one 256-byte page. */
+	int page;		/* Page it must be placed in, or -1. */
+	const char *with;	/* Section whose page it must share, or NULL. */
+	int rom_bank;		/* Logical ROM bank; it starts at offset rom_bank * MAX_ADDR. */
+	struct Instruction *head, *tail;
+	struct Section *next;
+};
+
+/*
+ * Cycle count assertion (.cycles_begin/.cycles_end), checked
+ * once the program is assembled.
+ */
+struct CycleCheck {
+	const char *name;
+	struct Instruction *begin, *end;	/* Position markers; end is NULL while open. */
+	int op;			/* '=', '<' (at most) or '>' (at least). */
+	int cycles;
+	char *cur_file;
+	int line_num;
+	struct CycleCheck *next;
 };
 
+/*
+ * Internal RAM variable (.ram directive), given an address once
+ * the program is laid out.
+ */
+struct RamVar {
+	const char *name;
+	int size;
+	struct Instruction *mark;	/* Position of the .ram directive. */
+	int routine;		/* Routine owning it, -1 if none. */
+	int dead;		/* Its routine was removed by -u. */
+	int addr;
+	char *cur_file;
+	int line_num;
+	struct RamVar *next;
+};
+
+/* Kinds of routine (find_routines). */
+#define ROUTINE_RESET	0	/* At the reset vector. */
+#define ROUTINE_IRQ	1	/* At an interrupt vector. */
+#define ROUTINE_CALLED	2	/* A call target. */
+
+/* Reset and interrupt vectors. */
+#define NUM_VECTORS	3
+
+/*
+ * A routine of the laid out program: a vector or a call target.
+ */
+struct Routine {
+	int addr;
+	int kind;		/* ROUTINE_xxx. */
+	int *callees;		/* Indexes of the routines it calls. */
+	int num_callees;
+};
+
+/* Control flow of an instruction (instruction_flow). */
+#define FLOW_NEXT	0	/* Continues with the next instruction. */
+#define FLOW_JUMP	1	/* JMP. */
+#define FLOW_BRANCH	2	/* Conditional jump or DJNZ. */
+#define FLOW_CALL	3	/* CALL. */
+#define FLOW_RET	4	/* RET or RETR. */
+#define FLOW_INDIRECT	5	/* JMPP @A. */
+
 /* Function prototypes. */
 
 /* err.c */
 void err_printf(const char *fmt, ...);
 void warn_printf(const char *fmt, ...);
+void error_at(const char *file, int line, int col, const char *fmt, ...);
+void warning_at(const char *file, int line, int col, const char *fmt, ...);
+void check_errors(void);
+void finish_diagnostics(void);
+extern int error_limit;
+extern const char *diag_file;
+
+/* keyword.c */
+#define KW_END		-1	/* .end */
+#define KW_ELSE		-2	/* .else */
+#define KW_ENDIF	-3	/* .endif */
+int keyword_token(const char *text, int len, int *value);
 
 /* pool.c */
 struct Pool *create_pool(int size);
@@ -126,33 +245,130 @@ struct Instruction *dbr(int value, int line_num);
 struct Instruction *db_expr(struct Expr *expr_val, int line_num);
 struct Instruction *dw_expr(struct Expr *expr_val, int line_num);
 struct Instruction *incbin(char *filename, int line_num);
+struct Instruction *incbin_packed(const char *name, char *filename, int method, int line_num);
+struct Instruction *jump_table_entry(struct Expr *addr, int line_num);
+void table(int count, struct Expr *expr, int width, int clamp, int min, int max, int line_num);
+int jump_table_targets(struct Instruction *jmpp, int *targets, int max);
+struct Instruction *new_mark(void);
+struct Instruction *mark(void);
+const char *fixup_kind(struct Instruction *ins);
+struct Instruction *fixup_ins(const char *kind, int size, struct Expr *expr);
 void append(struct Instruction *ins);
-void append_nostat(struct Instruction *ins);
+void insert_before(struct Instruction *pos, struct Instruction *ins);
 
 /* expr.c */
 struct Expr *mk_const_expr(int ival, int line_num);
 struct Expr *mk_symbolic_expr(const char *sym, int line_num, int mustexist);
+struct Expr *mk_mark_expr(struct Instruction *mark, int line_num);
 struct Expr *mk_unary_expr(int op, struct Expr *subexpr, int line_num);
 struct Expr *mk_binary_expr(int op, struct Expr *left, struct Expr *right, int line_num);
 int eval_expr(char *cur_file, struct Expr *expr);
+int expr_is_defined(struct Expr *expr);
+int expr_needs_fixup(struct Expr *expr);
+int expr_refers_to_label(struct Expr *expr);
+struct Instruction *expr_label(struct Expr *expr);
+struct Expr *bind_expr(struct Expr *expr);
+extern int table_index;
 
 /* symtab.c */
 const char *dup_str(const char *str);
-void define_symbol(const char *name, int value, int type);
-void redefine_symbol(const char *name, int value, int type);
+struct Symbol *define_symbol(const char *name, int value, int type);
+void define_label(const char *name);
+void export_symbol(const char *name, int line_num);
+void resolve_exports(void);
+struct Symbol *redefine_symbol(const char *name, int value, int type);
+void define_equate(const char *name, struct Expr *expr, int redefine);
+void update_equates(void);
 struct Symbol *lookup_symbol(const char *name);
 void export_symbols(const char *filename);
+void export_symbols_bin(const char *filename);
+void import_symbols(const char *filename);
+struct Symbol *first_symbol(void);
+
+/* ram.c */
+struct RamVar *add_ram_var(const char *name, int size, struct Instruction *mark, int line_num);
+void ram_var(const char *name, int size, int line_num);
+void allocate_ram(const char *map_file);
+
+/* routine.c */
+void index_code(void);
+void find_routines(void);
+extern const int routine_vectors[NUM_VECTORS];
+extern struct Instruction **code_at;
+extern struct Routine *routines;
+extern int num_routines;
+extern int *routine_at, *owner_at;
+
+/* strip.c */
+void strip_unreachable(void);
+
+/* merge.c */
+void merge_data(void);
+
+/* pack.c */
+int pack_rle(const unsigned char *in, int size, unsigned char *out);
+int pack_lz(const unsigned char *in, int size, unsigned char *out);
+
+/* bank.c */
+int insert_bank_selects(void);
+void check_banks(void);
+
+/* peephole.c */
+void optimize(void);
+
+/* section.c */
+struct Section *find_section(const char *name);
+struct Section *create_section(const char *name, int reloc);
+void select_section(const char *name);
+void select_rom_bank(int bank, int file_offset, int line_num);
+int rom_file_offset(int offset);
+void constrain_section(const char *kind, struct Expr *arg, int line_num);
+void place_sections(void);
+void layout(void);
+unsigned char *build_image(int *size);
+void compute_bank_usage(void);
+void report_free_space(void);
+
+/* object.c */
+int is_fixup(struct Instruction *ins);
+void write_object(const char *filename);
+void read_object(const char *filename);
+
+/* timing.c */
+void set_loop_bound(int min, int max, int line_num);
+void attach_loop_bound(struct Instruction *ins);
+void add_timing_path(const char *spec);
+int instruction_cycles(const unsigned char *buf, int size);
+int instruction_flow(struct Instruction *ins, int *target);
+void write_timing(const char *report_file, const char *graph_file);
+void cycles_begin(const char *name, int line_num);
+void cycles_end(const char *name, int op, int cycles, int line_num);
+struct CycleCheck *add_cycle_check(const char *name, struct Instruction *begin,
+	struct Instruction *end, int op, int cycles, int line_num);
+void check_cycles(void);
+extern struct CycleCheck *cycle_checks;
+extern struct RamVar *ram_vars;
+extern int ram_size;
 
 /* ihex.c */
 void load_file(char *filename);
+int load_hex(char *filename, int *minaddr, int *maxaddr);
 void save_file(char *command);
 
 /* Global variables */
-extern struct Instruction *ins_head, *ins_tail;
+extern struct Section *sect_head, *cur_section;
+extern int rom_bank_offset[MAX_ROM_BANKS];
 extern struct Pool *gen_pool;
 extern struct Pool *asm_pool;
 extern int cur_offset;
 extern char *cur_file;
+extern int object_mode;
+extern int strict_pages;
+extern int relax_branches;
+extern int select_banks;
+
+/* parse.y */
+extern int parse_src_line;
 
 /* asm48.c */
 void cur_file_set(const char *filename);
@@ -163,4 +379,7 @@ extern int bank_usage[BANK_USAGE_MAX];
 #define SYMB_CONST	0
 #define SYMB_LABEL	1
 
+#define SYMF_EXPORT	0x1	/* Listed by .export, visible to the linker. */
+#define SYMF_READONLY	0x2	/* Imported from a symbols file (-i). */
+
 #endif // ASM48_H
@@ -0,0 +1,342 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Memory bank tracking.  JMP and CALL only encode 11 address bits;
+ * the 12th comes from the bank selected by SEL MB0/SEL MB1.  The
+ * selected bank is followed along the control flow of the program,
+ * and every jmp and call is checked against the bank of its target.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asm48.h"
+
+/* Selected bank at a point of the program. */
+#define MB_NONE		0	/* Not reached. */
+#define MB_0		1	/* MB0 selected. */
+#define MB_1		2	/* MB1 selected. */
+#define MB_ENTRY	3	/* As on entry to the routine. */
+#define MB_UNKNOWN	4	/* Either bank. */
+
+/* SEL MB0 and SEL MB1 opcodes. */
+#define SEL_MB0		0xE5
+#define SEL_MB1		0xF5
+
+/* Bank problem found at a jmp or call. */
+#define BANK_OK		0
+#define BANK_UNKNOWN	1
+#define BANK_WRONG	2
+#define BANK_IRQ	3	/* Bank 1 target reached from an interrupt. */
+
+/*
+ * Banks of a routine (routines[] of routine.c).
+ */
+struct BankRoutine {
+	int entry;	/* Bank selected when it is called. */
+	int exit;	/* Bank selected when it returns, MB_ENTRY if unchanged. */
+	int irq;	/* Reached from an interrupt vector, so A11 is 0. */
+};
+
+static struct BankRoutine *banks;
+static int max_banks;
+
+/* Bank selected at each address, for the routine analysed last. */
+static unsigned char *state;
+
+/* Worklist of addresses. */
+static int *work;
+static int num_work;
+
+/*
+ * Combine the banks selected on two paths.
+ */
+static int join(int a, int b)
+{
+	if (a == MB_NONE)
+		return b;
+	if (b == MB_NONE || a == b)
+		return a;
+	return MB_UNKNOWN;
+}
+
+/*
+ * Bank selected, given the bank selected on entry to the routine.
+ */
+static int subst(int mb, int entry)
+{
+	return mb == MB_ENTRY ? entry : mb;
+}
+
+/*
+ * Find the routines, and forget what is known of their banks.
+ */
+static void init_banks(void)
+{
+	int r;
+
+	find_routines();
+	if (state == NULL) {
+		state = malloc(MAX_ADDR);
+		work = malloc(MAX_ADDR * sizeof(int));
+		if (state == NULL || work == NULL)
+			err_printf("Unable to allocate bank tables\n");
+	}
+	if (num_routines > max_banks) {
+		max_banks = num_routines;
+		banks = realloc(banks, max_banks * sizeof(struct BankRoutine));
+		if (banks == NULL)
+			err_printf("Unable to allocate bank tables\n");
+	}
+	for (r = 0; r < num_routines; r++) {
+		banks[r].entry = routines[r].kind == ROUTINE_RESET ? MB_0 : MB_NONE;
+		banks[r].exit = MB_NONE;
+		banks[r].irq = routines[r].kind == ROUTINE_IRQ;
+	}
+}
+
+static void propagate(int addr, int mb)
+{
+	int joined;
+
+	if (mb == MB_NONE || addr < 0 || addr >= MAX_ADDR)
+		return;
+	joined = join(state[addr], mb);
+	if (joined != state[addr]) {
+		state[addr] = joined;
+		work[num_work++] = addr;
+	}
+}
+
+/*
+ * Follow a routine from its entry, leaving the bank selected
+ * at each instruction in state[], relative to the bank on entry.
+ * Calls continue with the bank their routine returns with.
+ * Returns the bank selected when the routine returns.
+ */
+static int follow_routine(int r)
+{
+	struct Instruction *ins;
+	int addr, target, mb, exit = MB_NONE, callee, i;
+	int targets[256], num_targets;
+
+	memset(state, MB_NONE, MAX_ADDR);
+	num_work = 0;
+	propagate(routines[r].addr, MB_ENTRY);
+
+	while (num_work > 0) {
+		addr = work[--num_work];
+		ins = code_at[addr];
+		if (ins == NULL)
+			continue;
+		mb = state[addr];
+		switch (instruction_flow(ins, &target)) {
+			case FLOW_NEXT:
+				if (ins->size == 1 && ins->buf[0] == SEL_MB0)
+					mb = MB_0;
+				else if (ins->size == 1 && ins->buf[0] == SEL_MB1)
+					mb = MB_1;
+				propagate(addr + ins->size, mb);
+				break;
+			case FLOW_JUMP:
+				propagate(target, mb);
+				break;
+			case FLOW_BRANCH:
+				propagate(target, mb);
+				propagate(addr + ins->size, mb);
+				break;
+			case FLOW_CALL:
+				callee = target < MAX_ADDR ? routine_at[target] : -1;
+				if (callee >= 0)
+					propagate(addr + ins->size, subst(banks[callee].exit, mb));
+				break;
+			case FLOW_RET:
+				exit = join(exit, mb);
+				break;
+			case FLOW_INDIRECT:
+				num_targets = jump_table_targets(ins, targets, 256);
+				for (i = 0; i < num_targets; i++)
+					propagate(targets[i], mb);
+				break;
+		}
+	}
+	return exit;
+}
+
+/*
+ * Find the bank each routine is called with.  Reset starts with
+ * MB0.  Interrupt routines, and everything they call, run with A11
+ * held at 0 until RETR whatever bank is selected, so they are only
+ * marked irq and pass no bank on to their callees.
+ */
+static void analyse_banks(void)
+{
+	struct Instruction *ins;
+	int r, addr, target, mb, callee, changed;
+
+	init_banks();
+
+	/* What each routine returns with. */
+	do {
+		changed = 0;
+		for (r = 0; r < num_routines; r++) {
+			mb = follow_routine(r);
+			if (mb != banks[r].exit) {
+				banks[r].exit = mb;
+				changed = 1;
+			}
+		}
+	} while (changed);
+
+	/* What each routine is called with. */
+	do {
+		changed = 0;
+		for (r = 0; r < num_routines; r++) {
+			if (banks[r].entry == MB_NONE && !banks[r].irq)
+				continue;
+			follow_routine(r);
+			for (addr = 0; addr < MAX_ADDR; addr++) {
+				ins = code_at[addr];
+				if (state[addr] == MB_NONE || ins == NULL || instruction_flow(ins, &target) != FLOW_CALL
+						|| target >= MAX_ADDR || (callee = routine_at[target]) < 0)
+					continue;
+				if (banks[r].irq && !banks[callee].irq) {
+					banks[callee].irq = 1;
+					changed = 1;
+				}
+				if (banks[r].entry == MB_NONE)
+					continue;
+				mb = join(banks[callee].entry, subst(state[addr], banks[r].entry));
+				if (mb != banks[callee].entry) {
+					banks[callee].entry = mb;
+					changed = 1;
+				}
+			}
+		}
+	} while (changed);
+}
+
+/*
+ * Check the jmp and call instructions reached from each routine
+ * against the bank of their target.  Those reached from an interrupt
+ * can only go to bank 0.  Finds the worst problem at each address;
+ * problem[] holds BANK_xxx codes.
+ */
+static void find_bank_problems(unsigned char *problem)
+{
+	int r, addr, target, flow, mb;
+
+	memset(problem, BANK_OK, MAX_ADDR);
+	analyse_banks();
+	for (r = 0; r < num_routines; r++) {
+		if (banks[r].entry == MB_NONE && !banks[r].irq)
+			continue;
+		follow_routine(r);
+		for (addr = 0; addr < MAX_ADDR; addr++) {
+			if (state[addr] == MB_NONE || code_at[addr] == NULL)
+				continue;
+			flow = instruction_flow(code_at[addr], &target);
+			if (flow != FLOW_JUMP && flow != FLOW_CALL)
+				continue;
+			if (banks[r].irq && target >= BANK_SIZE)
+				problem[addr] = BANK_IRQ;
+			if (banks[r].entry == MB_NONE || problem[addr] == BANK_IRQ)
+				continue;
+			mb = subst(state[addr], banks[r].entry);
+			if (mb == MB_UNKNOWN) {
+				if (problem[addr] < BANK_UNKNOWN)
+					problem[addr] = BANK_UNKNOWN;
+			} else if ((mb == MB_1) != (target >= BANK_SIZE)) {
+				problem[addr] = BANK_WRONG;
+			}
+		}
+	}
+}
+
+/*
+ * Put a SEL MB0 or SEL MB1 in front of each jmp and call that
+ * may run with the wrong bank selected (-m option).  Returns the
+ * number added; the program must then be laid out again.
+ */
+int insert_bank_selects(void)
+{
+	unsigned char *problem = malloc(MAX_ADDR);
+	struct Instruction *ins;
+	int addr, target, added = 0;
+
+	if (problem == NULL)
+		err_printf("Unable to allocate bank tables\n");
+	find_bank_problems(problem);
+	for (addr = 0; addr < MAX_ADDR; addr++) {
+		/* No select helps an interrupt routine; check_banks() reports it. */
+		if (problem[addr] == BANK_OK || problem[addr] == BANK_IRQ)
+			continue;
+		ins = code_at[addr];
+		instruction_flow(ins, &target);
+		printf("   [%s] Line %d: sel mb%d added for %s to %04X\n", ins->cur_file, ins->src_line,
+			target >= BANK_SIZE, (ins->buf[0] & 0x1F) == 0x14 ? "call" : "jmp", target);
+		insert_before(ins, ins1(target >= BANK_SIZE ? SEL_MB1 : SEL_MB0));
+		added++;
+	}
+	free(problem);
+	return added;
+}
+
+/*
+ * Report the jmp and call instructions that run with the wrong
+ * bank selected or from an interrupt to bank 1 (an error), or with
+ * either bank selected (a warning).
+ */
+void check_banks(void)
+{
+	unsigned char *problem = malloc(MAX_ADDR);
+	struct Instruction *ins;
+	const char *what;
+	int addr, target;
+
+	if (problem == NULL)
+		err_printf("Unable to allocate bank tables\n");
+	find_bank_problems(problem);
+	for (addr = 0; addr < MAX_ADDR; addr++) {
+		if (problem[addr] == BANK_OK)
+			continue;
+		ins = code_at[addr];
+		instruction_flow(ins, &target);
+		what = (ins->buf[0] & 0x1F) == 0x14 ? "call" : "jmp";
+		if (problem[addr] == BANK_IRQ)
+			error_at(ins->cur_file, ins->src_line, 0, "%s to %04X from an interrupt routine, which runs in bank 0 until RETR",
+				what, target);
+		else if (problem[addr] == BANK_WRONG)
+			error_at(ins->cur_file, ins->src_line, 0, "%s to %04X needs MB%d selected",
+				what, target, target >= BANK_SIZE);
+		else
+			warning_at(ins->cur_file, ins->src_line, 0, "%s to %04X may run with either memory bank selected",
+				what, target);
+	}
+	free(problem);
+}
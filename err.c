@@ -28,20 +28,141 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include "asm48.h"
 
+#define MAX_MSG 1024
+
+/*
+ * A collected diagnostic.
+ */
+struct Diag {
+	const char *severity;
+	char *file;
+	int line, col;
+	char *msg;
+	struct Diag *next;
+};
+
+static struct Diag *diag_head, *diag_tail;
+static int num_errors, num_warnings;
+
+/* Stop after this many errors (0 = no limit). */
+int error_limit = 20;
+
+/* File receiving diagnostics in JSON form, or NULL. */
+const char *diag_file = NULL;
+
+/*
+ * Remember a diagnostic for the JSON report.
+ */
+static void record(const char *severity, const char *file, int line, int col, const char *msg)
+{
+	struct Diag *d = malloc(sizeof(struct Diag));
+	size_t len = strlen(msg);
+
+	if (d == NULL)
+		return;
+	d->severity = severity;
+	d->file = file ? strdup(file) : NULL;
+	d->line = line;
+	d->col = col;
+	d->msg = strdup(msg);
+	if (d->msg != NULL && len > 0 && d->msg[len - 1] == '\n')
+		d->msg[len - 1] = '\0';
+	d->next = NULL;
+
+	if (diag_head == NULL)
+		diag_head = diag_tail = d;
+	else {
+		diag_tail->next = d;
+		diag_tail = d;
+	}
+}
+
+/*
+ * Print and record a diagnostic at given source position.
+ * file may be NULL, and line or col 0, when unknown.
+ */
+static void report(const char *severity, const char *label, const char *file, int line, int col,
+	const char *fmt, va_list args)
+{
+	char msg[MAX_MSG];
+
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	fprintf(stderr, "%s: ", label);
+	if (file != NULL && line > 0 && col > 0)
+		fprintf(stderr, "[%s] Line %d, column %d: ", file, line, col);
+	else if (file != NULL && line > 0)
+		fprintf(stderr, "[%s] Line %d: ", file, line);
+	else if (file != NULL)
+		fprintf(stderr, "[%s] ", file);
+	fprintf(stderr, "%s\n", msg);
+	record(severity, file, line, col, msg);
+}
+
+/*
+ * Write a string as a JSON string literal.
+ */
+static void json_string(FILE *fp, const char *str)
+{
+	if (str == NULL) {
+		fprintf(fp, "null");
+		return;
+	}
+	fputc('"', fp);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(fp, "\\%c", *str);
+		else if ((unsigned char) *str < 0x20)
+			fprintf(fp, "\\u%04x", *str);
+		else
+			fputc(*str, fp);
+	}
+	fputc('"', fp);
+}
+
+/*
+ * Write all diagnostics to the JSON diagnostics file, if one was requested.
+ */
+void finish_diagnostics(void)
+{
+	struct Diag *d;
+	FILE *fp;
+
+	if (diag_file == NULL)
+		return;
+	fp = fopen(diag_file, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Couldn't open diagnostics file %s\n", diag_file);
+		return;
+	}
+
+	fprintf(fp, "[\n");
+	for (d = diag_head; d != NULL; d = d->next) {
+		fprintf(fp, "  {\"severity\": \"%s\", \"file\": ", d->severity);
+		json_string(fp, d->file);
+		fprintf(fp, ", \"line\": %d, \"column\": %d, \"message\": ", d->line, d->col);
+		json_string(fp, d->msg);
+		fprintf(fp, "}%s\n", d->next ? "," : "");
+	}
+	fprintf(fp, "]\n");
+	fclose(fp);
+}
+
 /*
  * Print an error message and die.
+ * Used for errors that assembly can't continue from.
  */
 void err_printf(const char *fmt, ...)
 {
 	va_list args;
 
-	fprintf(stderr, "Error: ");
 	va_start(args, fmt);
-	vfprintf(stderr, fmt, args);
+	report("error", "Error", NULL, 0, 0, fmt, args);
 	va_end(args);
 
+	finish_diagnostics();
 	exit(1);
 }
 
@@ -52,8 +173,54 @@ void warn_printf(const char *fmt, ...)
 {
 	va_list args;
 
-	fprintf(stderr, "Warning: ");
 	va_start(args, fmt);
-	vfprintf(stderr, fmt, args);
+	report("warning", "Warning", NULL, 0, 0, fmt, args);
+	va_end(args);
+	num_warnings++;
+}
+
+/*
+ * Report an error in the source and carry on, so that one run
+ * reports as many errors as possible.  Gives up once the error
+ * limit is reached.
+ */
+void error_at(const char *file, int line, int col, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	report("error", "Error", file, line, col, fmt, args);
+	va_end(args);
+
+	if (++num_errors == error_limit) {
+		fprintf(stderr, "Too many errors, stopping.\n");
+		finish_diagnostics();
+		exit(1);
+	}
+}
+
+/*
+ * Report a warning in the source.
+ */
+void warning_at(const char *file, int line, int col, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	report("warning", "Warning", file, line, col, fmt, args);
 	va_end(args);
+	num_warnings++;
+}
+
+/*
+ * Stop if any errors were reported so far.
+ */
+void check_errors(void)
+{
+	if (num_errors == 0)
+		return;
+	fprintf(stderr, "%d error%s, %d warning%s.\n", num_errors, num_errors == 1 ? "" : "s",
+		num_warnings, num_warnings == 1 ? "" : "s");
+	finish_diagnostics();
+	exit(1);
 }
@@ -32,6 +32,9 @@
 #include "parse.tab.h"
 #include "asm48.h"
 
+/* Value of .index while a .table is generated, -1 otherwise. */
+int table_index = -1;
+
 /*
  * Make an Expr object with given field values.
  */
@@ -44,8 +47,10 @@ static struct Expr *mk_expr(int op, struct Expr *left, struct Expr *right, const
 	expr->sym = sym;
 	expr->value = value;
 	expr->line_num = line_num;
+	expr->column = 0;
 	expr->cur_offset = cur_offset;
 	expr->mustexist = mustexist;
+	expr->mark = NULL;
 	return expr;
 }
 
@@ -62,7 +67,20 @@ struct Expr *mk_const_expr(int ival, int line_num)
  */
 struct Expr *mk_symbolic_expr(const char *sym, int line_num, int mustexist)
 {
-	return mk_expr(IDENTIFIER, NULL, NULL, sym, -1, line_num, mustexist);
+	struct Expr *expr = mk_expr(IDENTIFIER, NULL, NULL, sym, -1, line_num, mustexist);
+	if (strcmp(sym, ".here") == 0)
+		expr->mark = mark();
+	return expr;
+}
+
+/*
+ * Make an expression for the position of a marker.
+ */
+struct Expr *mk_mark_expr(struct Instruction *mark, int line_num)
+{
+	struct Expr *expr = mk_expr(IDENTIFIER, NULL, NULL, ".here", -1, line_num, 1);
+	expr->mark = mark;
+	return expr;
 }
 
 /*
@@ -94,15 +112,20 @@ int eval_expr(char *cur_file, struct Expr *expr)
 			return expr->value;
 
 		case IDENTIFIER:
+			if (expr->mark != NULL)			/* .here or linked label */
+				return ROM_ADDR(expr->mark->offset);
 			if (strcmp(expr->sym, ".here") == 0)	/* addr of current instruction */
-				return expr->cur_offset;
+				return ROM_ADDR(expr->cur_offset);
+			if (strcmp(expr->sym, ".index") == 0 && table_index >= 0)	/* .table entry */
+				return table_index;
 			symbol = lookup_symbol(expr->sym);
 			if (symbol == NULL) {
 				if (expr->mustexist)
-					err_printf("[%s] Line %d: Unknown symbol '%s'\n", cur_file, expr->line_num, expr->sym);
-				else
-					return 0;
+					error_at(cur_file, expr->line_num, expr->column, "Unknown symbol '%s'", expr->sym);
+				return 0;
 			}
+			if (symbol->expr != NULL)		/* Constant that refers to labels. */
+				return eval_expr(cur_file, symbol->expr);
 			return symbol->value;
 
 		case UMINUS:
@@ -156,13 +179,17 @@ int eval_expr(char *cur_file, struct Expr *expr)
 			return lval * rval;
 
 		case '/':
-			if (rval == 0)
-				err_printf("[%s] Line %d: Attempt to divide by zero\n", cur_file, expr->line_num);
+			if (rval == 0) {
+				error_at(cur_file, expr->line_num, expr->column, "Attempt to divide by zero");
+				return 0;
+			}
 			return lval / rval;
 
 		case '%':
-			if (rval == 0)
-				err_printf("[%s] Line %d: Attempt to modulo by zero\n", cur_file, expr->line_num);
+			if (rval == 0) {
+				error_at(cur_file, expr->line_num, expr->column, "Attempt to modulo by zero");
+				return 0;
+			}
 			return lval % rval;
 
 		case LSHIFT:
@@ -186,3 +213,128 @@ int eval_expr(char *cur_file, struct Expr *expr)
 
 	return -1;
 }
+
+/*
+ * Return nonzero if every symbol an expression refers to is defined.
+ */
+int expr_is_defined(struct Expr *expr)
+{
+	if (expr == NULL)
+		return 1;
+	if (expr->op == IDENTIFIER)
+		return expr->mark != NULL || strcmp(expr->sym, ".here") == 0 || lookup_symbol(expr->sym) != NULL
+			|| (strcmp(expr->sym, ".index") == 0 && table_index >= 0);
+	return expr_is_defined(expr->left) && expr_is_defined(expr->right);
+}
+
+/*
+ * Return nonzero if an expression can't be evaluated until the
+ * module is linked: it refers to an undefined (imported) symbol,
+ * or to a position inside a relocatable section.
+ */
+int expr_needs_fixup(struct Expr *expr)
+{
+	struct Symbol *symbol;
+	struct Instruction *pos;
+
+	if (expr == NULL)
+		return 0;
+
+	switch (expr->op) {
+		case INT_VALUE:
+			return 0;
+
+		case IDENTIFIER:
+			pos = expr->mark;
+			if (pos == NULL) {
+				symbol = lookup_symbol(expr->sym);
+				if (symbol == NULL)
+					return 1;
+				if (symbol->expr != NULL)
+					return expr_needs_fixup(symbol->expr);
+				pos = symbol->ins;
+			}
+			return pos != NULL && pos->section->reloc;
+	}
+
+	return expr_needs_fixup(expr->left) || expr_needs_fixup(expr->right);
+}
+
+/*
+ * Does an expression depend on the address of a label or mark?
+ * Such values change when code is moved or shrunk.
+ */
+int expr_refers_to_label(struct Expr *expr)
+{
+	struct Symbol *sym;
+
+	if (expr == NULL)
+		return 0;
+	if (expr->op == IDENTIFIER) {
+		if (expr->mark != NULL || strcmp(expr->sym, ".here") == 0)
+			return 1;
+		if (strcmp(expr->sym, ".index") == 0 && table_index >= 0)
+			return 0;
+		sym = lookup_symbol(expr->sym);
+		return sym == NULL || sym->type == SYMB_LABEL || sym->expr != NULL;
+	}
+	return expr_refers_to_label(expr->left) || expr_refers_to_label(expr->right);
+}
+
+/*
+ * Return the position marker of the label an expression consists
+ * of, or NULL if it is anything else.
+ */
+struct Instruction *expr_label(struct Expr *expr)
+{
+	struct Symbol *sym;
+
+	if (expr == NULL || expr->op != IDENTIFIER)
+		return NULL;
+	if (expr->mark != NULL)
+		return expr->mark;
+	sym = lookup_symbol(expr->sym);
+	return sym != NULL && sym->type == SYMB_LABEL ? sym->ins : NULL;
+}
+
+/*
+ * Copy an expression for a constant that refers to labels (.equ,
+ * .set): other constants and .index are replaced by their current
+ * value, and constants that refer to labels by their expression,
+ * so only labels and marks are evaluated when it is used.
+ */
+struct Expr *bind_expr(struct Expr *expr)
+{
+	struct Expr *copy;
+	struct Symbol *sym;
+
+	switch (expr->op) {
+		case INT_VALUE:
+			return expr;
+
+		case IDENTIFIER:
+			if (expr->mark != NULL)
+				return expr;
+			if (strcmp(expr->sym, ".index") == 0 && table_index >= 0)
+				return mk_const_expr(table_index, expr->line_num);
+			sym = lookup_symbol(expr->sym);
+			if (sym == NULL || sym->type == SYMB_LABEL)
+				return expr;
+			if (sym->expr != NULL)
+				return sym->expr;
+			return mk_const_expr(sym->value, expr->line_num);
+
+		case UMINUS:
+		case UNOTLOGIC:
+		case ULOW:
+		case UHIGH:
+			copy = mk_unary_expr(expr->op, bind_expr(expr->left), expr->line_num);
+			break;
+
+		default:
+			copy = mk_binary_expr(expr->op, bind_expr(expr->left), bind_expr(expr->right), expr->line_num);
+			break;
+	}
+	copy->column = expr->column;
+	return copy;
+}
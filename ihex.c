@@ -66,6 +66,49 @@ int *addr, *num, *code, bytes[];
 	return 1;
 }
 
+/* loads an intel hex file into the global memory[] array, */
+/* quietly: returns the number of bytes loaded and their */
+/* lowest and highest address, or -1 if the file can't be */
+/* read or has a bad line */
+
+int load_hex(filename, minaddr, maxaddr)
+char *filename;
+int *minaddr, *maxaddr;
+{
+	char line[1000];
+	FILE *fin;
+	int addr, n, status, bytes[256];
+	int i, total=0;
+
+	*minaddr = 65536;
+	*maxaddr = 0;
+	fin = fopen(filename, "r");
+	if (fin == NULL) return -1;
+	while (!feof(fin) && !ferror(fin)) {
+		line[0] = '\0';
+		if (fgets(line, 1000, fin) == NULL) break;
+		if (line[strlen(line)-1] == '\n') line[strlen(line)-1] = '\0';
+		if (line[strlen(line)-1] == '\r') line[strlen(line)-1] = '\0';
+		if (line[0] == '\0') continue;
+		if (!parse_hex_line(line, bytes, &addr, &n, &status)) {
+			fclose(fin);
+			return -1;
+		}
+		if (status == 0) {  /* data */
+			for(i=0; i<=(n-1); i++) {
+				memory[addr & 65535] = bytes[i] & 255;
+				total++;
+				if (addr < *minaddr) *minaddr = addr;
+				if (addr > *maxaddr) *maxaddr = addr;
+				addr++;
+			}
+		}
+		if (status == 1) break;  /* end of file */
+	}
+	fclose(fin);
+	return total;
+}
+
 /* loads an intel hex file into the global memory[] array */
 /* filename is a string of the file to be opened */
 
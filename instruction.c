@@ -56,7 +56,7 @@ static void assemble_db(struct Instruction *ins)
 {
 	int imm_val = eval_expr(ins->cur_file, ins->expr);
 	if (imm_val < -128 || imm_val > 255)
-		warn_printf("[%s] Line %d: immediate value %d exceeds range\n", ins->cur_file, ins->src_line, imm_val);
+		warning_at(ins->cur_file, ins->src_line, 0, "immediate value %d exceeds range", imm_val);
 	ins->buf[0] = imm_val;
 }
 
@@ -74,7 +74,7 @@ static void assemble_dw(struct Instruction *ins)
 {
 	int imm_val = eval_expr(ins->cur_file, ins->expr);
 	if (imm_val < -32768 || imm_val > 65535)
-		warn_printf("[%s] Line %d: immediate value %d exceeds range\n", ins->cur_file, ins->src_line, imm_val);
+		warning_at(ins->cur_file, ins->src_line, 0, "immediate value %d exceeds range", imm_val);
 	ins->buf[0] = imm_val & 0xFF;
 	ins->buf[1] = imm_val >> 8;
 }
@@ -94,7 +94,7 @@ static void assemble_imm_ins(struct Instruction *ins)
 	int imm_val = eval_expr(ins->cur_file, ins->expr);
 	/*printf("imm_val = %d\n", imm_val);*/
 	if (imm_val < -128 || imm_val > 255)
-		warn_printf("[%s] Line %d: immediate value %d exceeds range\n", ins->cur_file, ins->src_line, imm_val);
+		warning_at(ins->cur_file, ins->src_line, 0, "immediate value %d exceeds range", imm_val);
 	ins->buf[1] = imm_val;
 }
 
@@ -116,7 +116,7 @@ static void assemble_jmp(struct Instruction *ins)
 	 * Ensure that address is in range.
 	 */
 	if (address < 0 || address >= MAX_ADDR)
-		warn_printf("[%s] Line %d: address %d is out of range\n", ins->cur_file, ins->src_line, address);
+		warning_at(ins->cur_file, ins->src_line, 0, "address %d is out of range", address);
 	ins->buf[0] |= ((address >> 3) & 0xE0);
 	ins->buf[1] = address & 0xFF;
 	/*printf("Call to address %x - %2.2x %2.2x\n", address, ins->buf[0], ins->buf[1]);*/
@@ -137,8 +137,12 @@ static void assemble_j8(struct Instruction *ins)
 {
 	int address = eval_expr(ins->cur_file, ins->expr);
 	/*printf("address = %d\n", address);*/
-	if ((address & PAGE_MASK) != ((ins->offset+1) & PAGE_MASK))
-		warn_printf("[%s] Line %d: jump offset not in same page\n", ins->cur_file, ins->src_line);
+	if ((address & PAGE_MASK) != (ROM_ADDR(ins->offset+1) & PAGE_MASK)) {
+		if (strict_pages)
+			error_at(ins->cur_file, ins->src_line, 0, "jump target %d not in same page as %d", address, ROM_ADDR(ins->offset));
+		else
+			warning_at(ins->cur_file, ins->src_line, 0, "jump offset not in same page");
+	}
 	ins->buf[1] = address;
 }
 
@@ -149,6 +153,65 @@ static struct Vtable j8_ins_vtable = {
 	&assemble_j8,
 };
 
+/*
+ * Assemble() function for .jumptable entries: the offset of the
+ * target within the page, which must be the page of the table.
+ */
+static void assemble_jump_table(struct Instruction *ins)
+{
+	int address = eval_expr(ins->cur_file, ins->expr);
+	if ((address & PAGE_MASK) != (ROM_ADDR(ins->offset) & PAGE_MASK))
+		error_at(ins->cur_file, ins->src_line, 0, "jump table target %04X not in same page as table entry at %04X",
+			address, ROM_ADDR(ins->offset));
+	ins->buf[0] = address;
+}
+
+/*
+ * Vtable for .jumptable entries.
+ */
+static struct Vtable jump_table_vtable = {
+	&assemble_jump_table,
+};
+
+/*
+ * Assemble() function for .incbin_rle/.incbin_lz data: the unpack
+ * routines read it with movp through an 8-bit offset, so it must
+ * not cross a page.  Relocatable sections of an object file aren't
+ * placed yet.
+ */
+static void assemble_packed(struct Instruction *ins)
+{
+	if (ins->size == 0 || (object_mode && ins->section->reloc))
+		return;
+	if ((ROM_ADDR(ins->offset) & PAGE_MASK) != (ROM_ADDR(ins->offset + ins->size - 1) & PAGE_MASK))
+		error_at(ins->cur_file, ins->src_line, 0, "packed data at %04X crosses a page boundary",
+			ROM_ADDR(ins->offset));
+}
+
+/*
+ * Vtable for .incbin_rle/.incbin_lz data.
+ */
+static struct Vtable packed_vtable = {
+	&assemble_packed,
+};
+
+/*
+ * Fixup kinds written to object files, and the vtable
+ * that resolves each of them.
+ */
+static struct {
+	const char *kind;
+	struct Vtable *vtable;
+} fixup_kinds[] = {
+	{ "db", &db_vtable },
+	{ "dw", &dw_vtable },
+	{ "imm", &imm_ins_vtable },
+	{ "jmp", &jmp_vtable },
+	{ "j8", &j8_ins_vtable },
+	{ "jt", &jump_table_vtable },
+	{ NULL, NULL },
+};
+
 /***********************************************************************
  * Public functions
  ***********************************************************************/
@@ -162,12 +225,18 @@ struct Instruction *allocate_instruction(int size, int offset)
 	struct Instruction *ins = pool_alloc_buf(gen_pool, sizeof(struct Instruction));
 
 	ins->vtable = &noop_vtable;
+	ins->type = INS_CODE;
 	ins->size = size;
 	ins->offset = offset;
 	ins->src_line = -1;
 	ins->cur_file = cur_file;
 	ins->buf = buf;
 	ins->expr = NULL;
+	ins->value = 0;
+	ins->loop_min = 0;
+	ins->loop_max = -1;
+	ins->sym = NULL;
+	ins->section = NULL;
 	ins->next = NULL;
 
 	return ins;
@@ -318,12 +387,18 @@ struct Instruction *org(int address, int line_num)
 	struct Instruction *fill;
 
 	if (fill_size < 0) {
-		err_printf("[%s] Line %d: org directive of address %d less than current address %d\n",
-			cur_file, line_num, address, cur_offset);
+		error_at(cur_file, line_num, 0, "org directive of address %d less than current address %d",
+			address, cur_offset);
+		address = cur_offset;
+		fill_size = 0;
 	}
 
-	fill = allocate_instruction(fill_size, cur_offset);
-	memset(fill->buf, '\0', fill_size);
+	fill = allocate_instruction(1, cur_offset);
+	fill->type = INS_FILL;
+	fill->src_line = line_num;
+	fill->size = fill_size;
+	fill->value = address;
+	fill->buf[0] = '\0';
 	return fill;
 }
 
@@ -336,12 +411,18 @@ struct Instruction *orgfill(int address, int value, int line_num)
 	struct Instruction *fill;
 
 	if (fill_size < 0) {
-		err_printf("[%s] Line %d: orgfill directive of address %d less than current address %d\n",
-			cur_file, line_num, address, cur_offset);
+		error_at(cur_file, line_num, 0, "orgfill directive of address %d less than current address %d",
+			address, cur_offset);
+		address = cur_offset;
+		fill_size = 0;
 	}
 
-	fill = allocate_instruction(fill_size, cur_offset);
-	memset(fill->buf, value, fill_size);
+	fill = allocate_instruction(1, cur_offset);
+	fill->type = INS_FILL;
+	fill->src_line = line_num;
+	fill->size = fill_size;
+	fill->value = address;
+	fill->buf[0] = value;
 	return fill;
 }
 
@@ -352,7 +433,8 @@ struct Instruction *db(int value, int line_num)
 {
 	struct Instruction *db_ins = ins1(value);
 	if (value < -128 || value > 255)
-		warn_printf("[%s] Line %d: value %d is out of range for byte\n", cur_file, line_num, value);
+		warning_at(cur_file, line_num, 0, "value %d is out of range for byte", value);
+	db_ins->type = INS_DATA;
 	return db_ins;
 }
 
@@ -364,7 +446,7 @@ struct Instruction *dbr(int value, int line_num)
 	struct Instruction *db_ins;
 	int value2 = 0;
 	if (value < -128 || value > 255)
-		warn_printf("[%s] Line %d: value %d is out of range for byte\n", cur_file, line_num, value);
+		warning_at(cur_file, line_num, 0, "value %d is out of range for byte", value);
 	if (value & 0x01) value2 |= 0x80;
 	if (value & 0x02) value2 |= 0x40;
 	if (value & 0x04) value2 |= 0x20;
@@ -374,6 +456,7 @@ struct Instruction *dbr(int value, int line_num)
 	if (value & 0x40) value2 |= 0x02;
 	if (value & 0x80) value2 |= 0x01;
 	db_ins = ins1(value2);
+	db_ins->type = INS_DATA;
 	return db_ins;
 }
 
@@ -384,6 +467,7 @@ struct Instruction *db_expr(struct Expr *expr_val, int line_num)
 {
 	struct Instruction *db_ins = allocate_instruction(1, cur_offset);
 	db_ins->vtable = &db_vtable;
+	db_ins->type = INS_DATA;
 	db_ins->expr = expr_val;
 	db_ins->src_line = line_num;
 	return db_ins;
@@ -396,74 +480,300 @@ struct Instruction *dw_expr(struct Expr *expr_val, int line_num)
 {
 	struct Instruction *dw_ins = allocate_instruction(2, cur_offset);
 	dw_ins->vtable = &dw_vtable;
+	dw_ins->type = INS_DATA;
 	dw_ins->expr = expr_val;
 	dw_ins->src_line = line_num;
 	return dw_ins;
 }
 
 /*
- * Include a binary
+ * Assemble a .jumptable entry, the page offset of a target for
+ * JMPP @A.  A relocatable section holding a jump table is kept
+ * within one page.
  */
-struct Instruction *incbin(char *filename, int line_num)
+struct Instruction *jump_table_entry(struct Expr *addr, int line_num)
+{
+	struct Instruction *ins = allocate_instruction(1, cur_offset);
+	ins->vtable = &jump_table_vtable;
+	ins->type = INS_DATA;
+	ins->expr = addr;
+	ins->src_line = line_num;
+	if (cur_section->reloc)
+		cur_section->in_page = 1;
+	return ins;
+}
+
+/*
+ * Generate a table (.table directive): expr evaluated for .index
+ * from 0 to count - 1, as bytes or (width 2) little-endian words,
+ * clamped to min..max if clamp is nonzero, and append it.  Values
+ * that refer to labels become one .db or .dw per entry, resolved
+ * once the program is laid out.
+ */
+void table(int count, struct Expr *expr, int width, int clamp, int min, int max, int line_num)
 {
-	FILE *f;
-	int file_size;
 	struct Instruction *data;
+	int lo = width == 2 ? -32768 : -128, hi = width == 2 ? 65535 : 255;
+	int value, out_of_range = 0;
 
-	filename[strlen(filename)-1] = '\0'; ++filename;
-	f = fopen(filename, "rb");
+	if (count < 0 || (width != 1 && width != 2)) {
+		error_at(cur_file, line_num, 0, "Invalid table: count %d, width %d", count, width);
+		count = 0;
+	}
+	table_index = 0;
+	if (count > 0 && expr_refers_to_label(expr)) {
+		/* Like .db, this takes forward and imported labels. */
+		if (clamp)
+			error_at(cur_file, line_num, 0, "Table values that refer to labels can't be clamped");
+		for (table_index = 0; table_index < count; table_index++) {
+			if (width == 2)
+				append(dw_expr(bind_expr(expr), line_num));
+			else
+				append(db_expr(bind_expr(expr), line_num));
+		}
+		table_index = -1;
+		return;
+	}
 
+	data = allocate_instruction(count * width, cur_offset);
+	data->type = INS_DATA;
+	data->src_line = line_num;
+	for (table_index = 0; table_index < count; table_index++) {
+		value = eval_expr(cur_file, expr);
+		if (clamp)
+			value = value < min ? min : value > max ? max : value;
+		if (value < lo || value > hi)
+			out_of_range++;
+		data->buf[table_index * width] = value & 0xFF;
+		if (width == 2)
+			data->buf[table_index * width + 1] = (value >> 8) & 0xFF;
+	}
+	table_index = -1;
+
+	if (out_of_range)
+		warning_at(cur_file, line_num, 0, "%d table values out of range", out_of_range);
+	append(data);
+}
+
+/*
+ * Find the targets of a JMPP @A that is directly followed by a
+ * .jumptable.  Returns their number (at most max are stored),
+ * or -1 if there is no such table.
+ */
+int jump_table_targets(struct Instruction *jmpp, int *targets, int max)
+{
+	struct Instruction *ins;
+	int n = 0, value;
+
+	for (ins = jmpp->next; ins != NULL && ins->type == INS_LABEL; ins = ins->next)
+		;
+	if (ins == NULL || ins->vtable != &jump_table_vtable)
+		return -1;
+	for (; ins != NULL && (ins->vtable == &jump_table_vtable || ins->type == INS_LABEL); ins = ins->next) {
+		if (ins->type == INS_LABEL)
+			continue;
+		value = expr_is_defined(ins->expr) ? eval_expr(ins->cur_file, ins->expr) : ins->buf[0];
+		if (n < max)
+			targets[n] = ((jmpp->offset + 1) & PAGE_MASK) | (value & 0xFF);
+		n++;
+	}
+	return n < max ? n : max;
+}
+
+/*
+ * Read a binary file for .incbin and its variants.  Returns a
+ * malloc'd buffer, or NULL with a warning if the file can't be read.
+ */
+static unsigned char *load_binary(const char *filename, int *size, int line_num)
+{
+	FILE *f;
+	unsigned char *buf;
+
+	f = fopen(filename, "rb");
 	if(f == NULL) {
-		warn_printf("[%s] Line %d: unable to open file %s\n", cur_file, line_num, filename);
-		data = allocate_instruction(0, cur_offset);
-		return data;
+		warning_at(cur_file, line_num, 0, "unable to open file %s", filename);
+		*size = 0;
+		return NULL;
 	}
 
 	fseek(f, 0, SEEK_END);
-	file_size = ftell(f);
-	data = allocate_instruction(file_size, cur_offset);
+	*size = ftell(f);
+	buf = malloc(*size + 1);
 	fseek(f, 0, SEEK_SET);
-	fread(data->buf, 1, file_size, f);
+	*size = fread(buf, 1, *size, f);
 	fclose(f);
+	return buf;
+}
+
+/*
+ * Include a binary
+ */
+struct Instruction *incbin(char *filename, int line_num)
+{
+	int file_size;
+	unsigned char *buf;
+	struct Instruction *data;
+
+	filename[strlen(filename)-1] = '\0'; ++filename;
+	buf = load_binary(filename, &file_size, line_num);
+	data = allocate_instruction(file_size, cur_offset);
+	data->type = INS_DATA;
+	if (buf != NULL)
+		memcpy(data->buf, buf, file_size);
+	free(buf);
 	return data;
 }
 
 /*
- * Append given Instruction onto the end of the
- * instruction list.
+ * Include a binary compressed with PACK_RLE or PACK_LZ
+ * (.incbin_rle/.incbin_lz).  Defines the label NAME at the packed
+ * data, NAME_size as the original size and NAME_packed as the
+ * packed size.  The unpack routines address both the packed and
+ * the unpacked data with 8-bit registers, so neither may be over
+ * 256 bytes.
  */
-void append(struct Instruction *ins)
+struct Instruction *incbin_packed(const char *name, char *filename, int method, int line_num)
+{
+	int file_size, packed_size;
+	unsigned char *buf, *packed;
+	char *sym_name;
+	struct Instruction *data;
+
+	filename[strlen(filename)-1] = '\0'; ++filename;
+	buf = load_binary(filename, &file_size, line_num);
+	if (file_size > MAX_UNPACKED)
+		error_at(cur_file, line_num, 0, "%s is %d bytes; at most %d can be unpacked",
+			filename, file_size, MAX_UNPACKED);
+	packed = malloc(PACK_BOUND(file_size));
+	if (packed == NULL)
+		err_printf("Unable to allocate packed data for %s\n", filename);
+	if (method == PACK_LZ)
+		packed_size = pack_lz(buf, file_size, packed);
+	else
+		packed_size = pack_rle(buf, file_size, packed);
+	if (packed_size > MAX_PACKED)
+		error_at(cur_file, line_num, 0, "%s packs into %d bytes, more than a page",
+			filename, packed_size);
+
+	define_label(name);
+	sym_name = malloc(strlen(name) + sizeof("_packed"));
+	if (sym_name == NULL)
+		err_printf("Unable to allocate symbol name\n");
+	sprintf(sym_name, "%s_size", name);
+	define_symbol(sym_name, file_size, SYMB_CONST);
+	sprintf(sym_name, "%s_packed", name);
+	define_symbol(sym_name, packed_size, SYMB_CONST);
+	free(sym_name);
+
+	data = allocate_instruction(packed_size, cur_offset);
+	data->type = INS_DATA;
+	data->vtable = &packed_vtable;
+	data->src_line = line_num;
+	memcpy(data->buf, packed, packed_size);
+	free(packed);
+	free(buf);
+	return data;
+}
+
+/*
+ * Create a zero-sized position marker with a new id.
+ */
+struct Instruction *new_mark(void)
+{
+	static int next_id;
+	struct Instruction *ins = allocate_instruction(0, cur_offset);
+	ins->type = INS_LABEL;
+	ins->value = next_id++;
+	return ins;
+}
+
+/*
+ * Append a zero-sized marker at the current position.  Layout keeps
+ * its offset up to date, so labels and .here follow the code when
+ * sections are placed.
+ */
+struct Instruction *mark(void)
+{
+	struct Instruction *ins = new_mark();
+	append(ins);
+	return ins;
+}
+
+/*
+ * Insert an instruction in front of a code instruction of the
+ * laid out program.  The two swap places in memory, so the
+ * list needs no back pointers; pos must not be a marker, as
+ * labels keep pointers to those.
+ */
+void insert_before(struct Instruction *pos, struct Instruction *ins)
+{
+	struct Instruction tmp = *pos;
+
+	*pos = *ins;
+	*ins = tmp;
+	pos->section = ins->section;
+	pos->cur_file = ins->cur_file;
+	pos->src_line = ins->src_line;
+	pos->offset = ins->offset;
+	pos->next = ins;
+	if (ins->section->tail == pos)
+		ins->section->tail = ins;
+}
+
+/*
+ * Return the object file fixup kind of an instruction
+ * whose operand is resolved by its assemble() method,
+ * or NULL if it has none.
+ */
+const char *fixup_kind(struct Instruction *ins)
 {
 	int i;
-	assert(ins->next == NULL);
-	if (ins_head == NULL) {
-		ins_head = ins_tail = ins;
-	} else {
-		assert(ins->offset >= ins_tail->offset);
-		assert(ins->offset != ins_tail->offset || ins_tail->size == 0);
-		ins_tail->next = ins;
-		ins_tail = ins;
+	for (i = 0; fixup_kinds[i].kind != NULL; i++) {
+		if (fixup_kinds[i].vtable == ins->vtable)
+			return fixup_kinds[i].kind;
 	}
-	if (cur_offset < (BANK_USAGE_MAX * 256)) {
-		for (i=0; i<ins->size; i++) bank_usage[(cur_offset+i)>>8]++;
+	return NULL;
+}
+
+/*
+ * Create an instruction of given fixup kind, to be resolved
+ * by evaluating expr.  The caller fills in the encoded bytes.
+ */
+struct Instruction *fixup_ins(const char *kind, int size, struct Expr *expr)
+{
+	struct Instruction *ins;
+	int i;
+
+	for (i = 0; fixup_kinds[i].kind != NULL; i++) {
+		if (strcmp(fixup_kinds[i].kind, kind) == 0)
+			break;
 	}
-	cur_offset += ins->size;
+	if (fixup_kinds[i].kind == NULL)
+		err_printf("[%s] Unknown fixup kind %s\n", cur_file, kind);
+
+	ins = allocate_instruction(size, cur_offset);
+	ins->vtable = fixup_kinds[i].vtable;
+	ins->expr = expr;
+	return ins;
 }
 
 /*
  * Append given Instruction onto the end of the
- * instruction list. It doesn't add into the bank usage statistic
+ * current section.
  */
-void append_nostat(struct Instruction *ins)
+void append(struct Instruction *ins)
 {
+	struct Section *sect = cur_section;
+
 	assert(ins->next == NULL);
-	if (ins_head == NULL) {
-		ins_head = ins_tail = ins;
+	ins->section = sect;
+	if (sect->head == NULL) {
+		sect->head = sect->tail = ins;
 	} else {
-		assert(ins->offset >= ins_tail->offset);
-		assert(ins->offset != ins_tail->offset || ins_tail->size == 0);
-		ins_tail->next = ins;
-		ins_tail = ins;
+		assert(ins->offset >= sect->tail->offset);
+		assert(ins->offset != sect->tail->offset || sect->tail->size == 0);
+		sect->tail->next = ins;
+		sect->tail = ins;
 	}
 	cur_offset += ins->size;
 }
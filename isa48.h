@@ -0,0 +1,145 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The MCS-48 instruction set, one line per opcode pattern:
+ *
+ *	INSN(encoding, format, cycles)
+ *
+ * The encoding gives the bits of the instruction, first byte first:
+ * 0 and 1 are fixed, r a register, d immediate data, a address bits,
+ * p an expander port and b a bit number (spaces are ignored).  Eight
+ * bits make a one-byte instruction, sixteen a two-byte one.  The
+ * format is what the disassembler prints, and cycles the machine
+ * cycles the instruction takes.
+ *
+ * 8039dasm.c builds its decoder from this table, and timing.c and
+ * sim48.c their cycle counts.  There is no include guard: define
+ * INSN, include the file and undefine INSN again.
+ */
+
+INSN("00000011dddddddd",  "add  a,#$%X",     2)
+INSN("01101rrr",          "add  a,%R",       1)
+INSN("0110000r",          "add  a,@%R",      1)
+INSN("00010011dddddddd",  "addc a,#$%X",     2)
+INSN("01111rrr",          "addc a,%R",       1)
+INSN("0111000r",          "addc a,@%R",      1)
+INSN("01010011dddddddd",  "anl  a,#$%X",     2)
+INSN("01011rrr",          "anl  a,%R",       1)
+INSN("0101000r",          "anl  a,@%R",      1)
+INSN("10011000dddddddd",  "anl  bus,#$%X",   2)
+INSN("10011001dddddddd",  "anl  p1,#$%X",    2)
+INSN("10011010dddddddd",  "anl  p2,#$%X",    2)
+INSN("100111pp",          "anld %P,a",       2)
+INSN("aaa10100aaaaaaaa",  "call %A",         2)
+INSN("00100111",          "clr  a",          1)
+INSN("10010111",          "clr  c",          1)
+INSN("10100101",          "clr  f1",         1)
+INSN("10000101",          "clr  f0",         1)
+INSN("00110111",          "cpl  a",          1)
+INSN("10100111",          "cpl  c",          1)
+INSN("10010101",          "cpl  f0",         1)
+INSN("10110101",          "cpl  f1",         1)
+INSN("01010111",          "da   a",          1)
+INSN("00000111",          "dec  a",          1)
+INSN("11001rrr",          "dec  %R",         1)
+INSN("00010101",          "dis  i",          1)
+INSN("00110101",          "dis  tcnti",      1)
+INSN("11101rrraaaaaaaa",  "djnz %R,%J",      2)
+INSN("00000101",          "en   i",          1)
+INSN("00100101",          "en   tcnti",      1)
+INSN("01110101",          "ent0 clk",        1)
+INSN("00001001",          "in   a,p1",       2)
+INSN("00001010",          "in   a,p2",       2)
+INSN("00010111",          "inc  a",          1)
+INSN("00011rrr",          "inc  %R",         1)
+INSN("0001000r",          "inc  @%R",        1)
+INSN("00001000",          "ins  a,bus",      2)
+INSN("0001 0110aaaaaaaa", "jtf  %J",         2)
+INSN("0010 0110aaaaaaaa", "jnt0 %J",         2)
+INSN("0011 0110aaaaaaaa", "jt0  %J",         2)
+INSN("0100 0110aaaaaaaa", "jnt1 %J",         2)
+INSN("0101 0110aaaaaaaa", "jt1  %J",         2)
+INSN("0111 0110aaaaaaaa", "jf1  %J",         2)
+INSN("1000 0110aaaaaaaa", "jni  %J",         2)
+INSN("1001 0110aaaaaaaa", "jnz  %J",         2)
+INSN("1011 0110aaaaaaaa", "jf0  %J",         2)
+INSN("1100 0110aaaaaaaa", "jz   %J",         2)
+INSN("1110 0110aaaaaaaa", "jnc  %J",         2)
+INSN("1111 0110aaaaaaaa", "jc   %J",         2)
+INSN("bbb10010aaaaaaaa",  "jb%B  %J",        2)
+INSN("aaa00100aaaaaaaa",  "jmp  %A",         2)
+INSN("10110011",          "jmpp @a",         2)
+INSN("00100011dddddddd",  "mov  a,#$%X",     2)
+INSN("11111rrr",          "mov  a,%R",       1)
+INSN("1111000r",          "mov  a,@%R",      1)
+INSN("11000111",          "mov  a,psw",      1)
+INSN("10111rrrdddddddd",  "mov  %R,#$%X",    2)
+INSN("10101rrr",          "mov  %R,a",       1)
+INSN("1010000r",          "mov  @%R,a",      1)
+INSN("1011000rdddddddd",  "mov  @%R,#$%X",   2)
+INSN("11010111",          "mov  psw,a",      1)
+INSN("000011pp",          "movd a,%P",       2)
+INSN("001111pp",          "movd %P,a",       2)
+INSN("01000010",          "mov  a,t",        1)
+INSN("01100010",          "mov  t,a",        1)
+INSN("11100011",          "movp3 a,@a",      2)
+INSN("10100011",          "movp a,@a",       2)
+INSN("1000000r",          "movx a,@%R",      2)
+INSN("1001000r",          "movx @%R,a",      2)
+INSN("0100 1rrr",         "orl  a,%R",       1)
+INSN("0100 000r",         "orl  a,@%R",      1)
+INSN("0100 0011dddddddd", "orl  a,#$%X",     2)
+INSN("1000 1000dddddddd", "orl  bus,#$%X",   2)
+INSN("1000 1001dddddddd", "orl  p1,#$%X",    2)
+INSN("1000 1010dddddddd", "orl  p2,#$%X",    2)
+INSN("1000 11pp",         "orld %P,a",       2)
+INSN("00000010",          "outl bus,a",      2)
+/* INSN("001110pp",          "outl %p,a",       2) */
+INSN("00111001",          "outl p1,a",       2)
+INSN("00111010",          "outl p2,a",       2)
+INSN("10000011",          "ret",             2)
+INSN("10010011",          "retr",            2)
+INSN("11100111",          "rl   a",          1)
+INSN("11110111",          "rlc  a",          1)
+INSN("01110111",          "rr   a",          1)
+INSN("01100111",          "rrc  a",          1)
+INSN("11100101",          "sel  mb0",        1)
+INSN("11110101",          "sel  mb1",        1)
+INSN("11000101",          "sel  rb0",        1)
+INSN("11010101",          "sel  rb1",        1)
+INSN("01100101",          "stop tcnt",       1)
+INSN("01000101",          "strt cnt",        1)
+INSN("01010101",          "strt t",          1)
+INSN("01000111",          "swap a",          1)
+INSN("00101rrr",          "xch  a,%R",       1)
+INSN("0010000r",          "xch  a,@%R",      1)
+INSN("0011000r",          "xchd a,@%R",      1)
+INSN("1101 0011dddddddd", "xrl  a,#$%X",     2)
+INSN("1101 1rrr",         "xrl  a,%R",       1)
+INSN("1101 000r",         "xrl  a,@%R",      1)
+INSN("00000000",          "nop",             1)
@@ -0,0 +1,233 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Keyword recognition for the scanner.  lex.l matches every word
+ * with one identifier rule and asks keyword_token() whether it is
+ * a mnemonic, register, port, flag or directive, in any case.
+ *
+ * The lookup is a perfect hash over the lower-case keywords: the
+ * word's hash picks one of NUM_BUCKETS displacements, which picks
+ * its slot, so one string compare settles it.  displacement[] and
+ * slot_keyword[] are generated from keywords[]; after changing the
+ * list, rebuild them with
+ *
+ *	cc -DKEYWORD_GEN -o kwgen keyword.c && ./kwgen
+ *
+ * and paste the output over the tables below.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "asm48.h"
+#include "parse.tab.h"
+
+#define NUM_BUCKETS 64
+#define NUM_SLOTS 128
+#define MAX_KEYWORD_LEN 16
+
+static const struct {
+	const char *name;
+	int token;
+	int value;		/* Register, port or bit number. */
+} keywords[] = {
+	/* Operands. */
+	{ "a", A, 0 }, { "psw", PSW, 0 }, { "bus", BUS, 0 }, { "c", C, 0 },
+	{ "i", I, 0 }, { "tcnti", TCNTI, 0 }, { "clk", CLK, 0 }, { "t", T, 0 },
+	{ "tcnt", TCNT, 0 }, { "cnt", CNT, 0 },
+	{ "r0", DEREF_REG, 0 }, { "r1", DEREF_REG, 1 },
+	{ "r2", GENERAL_REG, 2 }, { "r3", GENERAL_REG, 3 }, { "r4", GENERAL_REG, 4 },
+	{ "r5", GENERAL_REG, 5 }, { "r6", GENERAL_REG, 6 }, { "r7", GENERAL_REG, 7 },
+	{ "p0", P0, 0 }, { "p1", P12, 1 }, { "p2", P12, 2 },
+	{ "p4", P47, 4 }, { "p5", P47, 5 }, { "p6", P47, 6 }, { "p7", P47, 7 },
+	{ "f0", F, 0 }, { "f1", F, 1 }, { "mb0", MB, 0 }, { "mb1", MB, 1 },
+	{ "rb0", RB, 0 }, { "rb1", RB, 1 },
+
+	/* Directives. */
+	{ ".equ", EQU, 0 }, { ".set", SET, 0 }, { ".define", SET, 0 },
+	{ ".org", ORG, 0 }, { ".db", DB, 0 }, { ".dw", DW, 0 }, { ".dbr", DBR, 0 },
+	{ ".incbin", INCBIN, 0 }, { ".incbin_rle", INCBIN_RLE, 0 },
+	{ ".incbin_lz", INCBIN_LZ, 0 }, { ".section", SECTION, 0 },
+	{ ".export", EXPORT, 0 }, { ".loop", LOOP, 0 },
+	{ ".cycles_begin", CYCLES_BEGIN, 0 }, { ".cycles_end", CYCLES_END, 0 },
+	{ ".jumptable", JUMPTABLE, 0 }, { ".table", TABLE, 0 }, { ".ram", RAM, 0 },
+	{ ".bank", BANK, 0 }, { ".end", KW_END, 0 }, { ".exit", TEOF, 0 },
+	{ ".message", MESSAGE, 0 }, { ".warning", WARNING, 0 }, { ".error", ERROR, 0 },
+	{ ".if", IF, 0 }, { ".ifdef", IFDEF, 0 }, { ".ifndef", IFNDEF, 0 },
+	{ ".ifset", IFDEF, 0 }, { ".ifnset", IFNDEF, 0 },
+	{ ".else", KW_ELSE, 0 }, { ".endif", KW_ENDIF, 0 },
+
+	/* Instruction mnemonics. */
+	{ "add", ADD, 0 }, { "addc", ADDC, 0 }, { "anl", ANL, 0 }, { "anld", ANLD, 0 },
+	{ "call", CALL, 0 }, { "clr", CLR, 0 }, { "cpl", CPL, 0 }, { "da", DA, 0 },
+	{ "dec", DEC, 0 }, { "dis", DIS, 0 }, { "djnz", DJNZ, 0 }, { "en", EN, 0 },
+	{ "ent0", ENT0, 0 }, { "in", IN, 0 }, { "inc", INC, 0 }, { "ins", INS, 0 },
+	{ "jb0", JB, 0 }, { "jb1", JB, 1 }, { "jb2", JB, 2 }, { "jb3", JB, 3 },
+	{ "jb4", JB, 4 }, { "jb5", JB, 5 }, { "jb6", JB, 6 }, { "jb7", JB, 7 },
+	{ "jc", JC, 0 }, { "jf0", JF0, 0 }, { "jf1", JF1, 0 }, { "jmp", JMP, 0 },
+	{ "jmpp", JMPP, 0 }, { "jnc", JNC, 0 }, { "jni", JNI, 0 }, { "jnt0", JNT0, 0 },
+	{ "jnt1", JNT1, 0 }, { "jnz", JNZ, 0 }, { "jtf", JTF, 0 }, { "jt0", JT0, 0 },
+	{ "jt1", JT1, 0 }, { "jz", JZ, 0 }, { "mov", MOV, 0 }, { "movd", MOVD, 0 },
+	{ "movp", MOVP, 0 }, { "movp3", MOVP3, 0 }, { "movx", MOVX, 0 }, { "nop", NOP, 0 },
+	{ "orl", ORL, 0 }, { "orld", ORLD, 0 }, { "outl", OUTL, 0 }, { "ret", RET, 0 },
+	{ "retr", RETR, 0 }, { "rl", RL, 0 }, { "rlc", RLC, 0 }, { "rr", RR, 0 },
+	{ "rrc", RRC, 0 }, { "sel", SEL, 0 }, { "stop", STOP, 0 }, { "strt", STRT, 0 },
+	{ "swap", SWAP, 0 }, { "xch", XCH, 0 }, { "xchd", XCHD, 0 }, { "xrl", XRL, 0 },
+	{ NULL, 0, 0 }
+};
+
+#define NUM_KEYWORDS ((int) (sizeof(keywords) / sizeof(keywords[0])) - 1)
+
+/* Generated: the seed for each bucket's words. */
+static const unsigned short displacement[NUM_BUCKETS] = {
+	5, 4, 0, 0, 1, 4, 5, 5, 1, 4, 28, 5,
+	1, 13, 11, 5, 1, 11, 5, 1, 4, 7, 21, 15,
+	0, 15, 1, 29, 0, 0, 12, 0, 2, 5, 4, 1,
+	0, 17, 2, 10, 20, 7, 17, 11, 1, 4, 13, 0,
+	0, 3, 2, 30, 14, 6, 34, 3, 1, 12, 9, 44,
+	0, 0, 13, 1,
+};
+
+/* Generated: 1 + index in keywords[] of each slot's word, 0 for none. */
+static const unsigned char slot_keyword[NUM_SLOTS] = {
+	6, 81, 38, 110, 44, 34, 67, 70, 96, 28, 76, 111, 115, 91, 36, 107,
+	8, 100, 55, 18, 77, 27, 49, 112, 51, 4, 39, 68, 32, 101, 116, 20,
+	13, 72, 105, 87, 0, 57, 85, 23, 0, 119, 75, 104, 50, 15, 16, 83,
+	30, 82, 69, 94, 0, 22, 11, 45, 33, 121, 17, 93, 88, 122, 48, 1,
+	7, 92, 97, 31, 103, 99, 26, 86, 19, 12, 24, 0, 79, 21, 62, 89,
+	2, 35, 78, 0, 37, 106, 46, 5, 108, 102, 47, 9, 117, 53, 63, 14,
+	114, 42, 29, 60, 84, 118, 40, 120, 43, 65, 73, 113, 58, 3, 74, 59,
+	52, 25, 54, 10, 71, 109, 80, 66, 61, 56, 41, 90, 0, 98, 95, 64,
+};
+
+/*
+ * FNV-1a hash of a lower-case word, started from a seed.
+ */
+static unsigned hash(const char *word, int len, unsigned seed)
+{
+	unsigned h = 2166136261U ^ seed;
+
+	while (len-- > 0) {
+		h ^= (unsigned char) *word++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/*
+ * Return the token of the keyword a word spells, ignoring case,
+ * storing its register, port or bit number in *value; or 0 if the
+ * word isn't a keyword.
+ */
+int keyword_token(const char *text, int len, int *value)
+{
+	char word[MAX_KEYWORD_LEN];
+	int i, k;
+
+	if (len >= MAX_KEYWORD_LEN)
+		return 0;
+	for (i = 0; i < len; i++)
+		word[i] = tolower((unsigned char) text[i]);
+	word[len] = '\0';
+
+	k = slot_keyword[hash(word, len, displacement[hash(word, len, 0) % NUM_BUCKETS]) % NUM_SLOTS];
+	if (k == 0 || strcmp(keywords[k - 1].name, word) != 0)
+		return 0;
+	*value = keywords[k - 1].value;
+	return keywords[k - 1].token;
+}
+
+#ifdef KEYWORD_GEN
+/*
+ * Find a displacement for every bucket, largest buckets first, so
+ * that all keywords land in different slots, and print the tables.
+ */
+int main(void)
+{
+	int bucket_of[NUM_KEYWORDS], order[NUM_BUCKETS], size[NUM_BUCKETS];
+	unsigned disp[NUM_BUCKETS];
+	int slot[NUM_SLOTS], taken[NUM_KEYWORDS];
+	int i, j, b, n, t, ok;
+	unsigned d;
+
+	memset(size, 0, sizeof(size));
+	for (i = 0; i < NUM_KEYWORDS; i++) {
+		bucket_of[i] = hash(keywords[i].name, strlen(keywords[i].name), 0) % NUM_BUCKETS;
+		size[bucket_of[i]]++;
+	}
+	for (b = 0; b < NUM_BUCKETS; b++)
+		order[b] = b;
+	for (i = 1; i < NUM_BUCKETS; i++) {
+		for (j = i; j > 0 && size[order[j]] > size[order[j - 1]]; j--) {
+			t = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = t;
+		}
+	}
+	memset(slot, 0, sizeof(slot));
+	memset(disp, 0, sizeof(disp));
+	for (i = 0; i < NUM_BUCKETS && size[order[i]] > 0; i++) {
+		b = order[i];
+		for (d = 1; d < 65536; d++) {
+			n = 0;
+			ok = 1;
+			for (j = 0; j < NUM_KEYWORDS && ok; j++) {
+				if (bucket_of[j] != b)
+					continue;
+				t = hash(keywords[j].name, strlen(keywords[j].name), d) % NUM_SLOTS;
+				if (slot[t] != 0)
+					ok = 0;
+				else {
+					slot[t] = j + 1;
+					taken[n++] = t;
+				}
+			}
+			if (ok)
+				break;
+			while (n > 0)
+				slot[taken[--n]] = 0;
+		}
+		if (d == 65536) {
+			fprintf(stderr, "No displacement for bucket %d; raise NUM_SLOTS\n", b);
+			return 1;
+		}
+		disp[b] = d;
+	}
+
+	printf("static const unsigned short displacement[NUM_BUCKETS] = {");
+	for (b = 0; b < NUM_BUCKETS; b++)
+		printf("%s%u,", b % 12 ? " " : "\n\t", disp[b]);
+	printf("\n};\n\n");
+	printf("static const unsigned char slot_keyword[NUM_SLOTS] = {");
+	for (i = 0; i < NUM_SLOTS; i++)
+		printf("%s%d,", i % 16 ? " " : "\n\t", slot[i]);
+	printf("\n};\n");
+	return 0;
+}
+#endif /* KEYWORD_GEN */
@@ -0,0 +1,59 @@
+; unlz - unpack data included with .incbin_lz into external RAM.
+;
+;	.include "lib/unlz.asm"
+;
+; In:	r2 = offset of the packed data in its page (<NAME)
+;	r0 = destination address in external RAM
+; Out:	r0 = address after the last byte written
+; Uses:	a, r1, r2, r3, one stack level plus the one of the call
+;
+; Matches are copied from the bytes already unpacked, up to 255
+; bytes back, so the whole output must stay in external RAM until
+; unlz returns.  Packed bytes are read by calling unpack_get with
+; their page offset in a.  The program supplies it, in the page
+; holding the data:
+;
+;	unpack_get:	movp a, @a
+;			ret
+;
+; Cycles:
+;	2		call
+;	12		end of data, with the return
+;	15 + 13 * N	block of N literal bytes
+;	31 + 8 * N	match of N bytes
+
+unlz:
+	mov a, r2		; 1
+	call unpack_get		; 2 + 4
+	inc r2			; 1
+	jz unlz_end		; 2
+	jb7 unlz_match		; 2
+	mov r3, a		; 1	01..7F: literal bytes
+unlz_lit:
+	mov a, r2		; 1
+	call unpack_get		; 2 + 4
+	inc r2			; 1
+	movx @r0, a		; 2
+	inc r0			; 1
+	djnz r3, unlz_lit	; 2
+	jmp unlz		; 2
+unlz_match:
+	anl a, #0x7F		; 2	80..FF: copy from the output
+	add a, #3		; 2
+	mov r3, a		; 1
+	mov a, r2		; 1
+	call unpack_get		; 2 + 4
+	inc r2			; 1
+	cpl a			; 1	r1 = r0 - distance
+	inc a			; 1
+	add a, r0		; 1
+	mov r1, a		; 1
+unlz_copy:
+	movx a, @r1		; 2
+	movx @r0, a		; 2
+	inc r0			; 1
+	inc r1			; 1
+	djnz r3, unlz_copy	; 2
+	jmp unlz		; 2
+unlz_end:
+	ret			; 2
@@ -0,0 +1,64 @@
+; Test for lib/unrle.asm and lib/unlz.asm.  Unpacks the same file
+; with both and compares the result with the unpacked original.
+; Run from the top directory; it stops at "pass" when both work:
+;
+;	asm48 -s test.sym -o test.bin lib/unpack_test.asm
+;	sim48 -s test.sym test.bin
+
+.org 0
+	mov r2, <rle_data
+	mov r0, #0
+	call unrle
+	call verify
+
+	call clear
+	mov r2, <lz_data
+	mov r0, #0
+	call unlz
+	call verify
+pass:
+	jmp pass
+fail:
+	jmp fail
+
+; Check that the external RAM holds the original data.
+verify:
+	mov a, r0
+	xrl a, #orig_size
+	jnz fail
+	mov r1, #0
+verify_loop:
+	mov a, r1
+	movp3 a, @a
+	mov r4, a
+	movx a, @r1
+	xrl a, r4
+	jnz fail
+	inc r1
+	mov a, r1
+	xrl a, #orig_size
+	jnz verify_loop
+	ret
+
+; Clear the external RAM.
+clear:
+	clr a
+	mov r0, a
+clear_loop:
+	movx @r0, a
+	djnz r0, clear_loop
+	ret
+
+	.include "lib/unrle.asm"
+	.include "lib/unlz.asm"
+
+.org 0x200
+unpack_get:
+	movp a, @a
+	ret
+	.incbin_rle rle_data, "lib/unpack_test.bin"
+	.incbin_lz lz_data, "lib/unpack_test.bin"
+
+.org 0x300
+	.incbin "lib/unpack_test.bin"
+.equ orig_size, rle_data_size
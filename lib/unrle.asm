@@ -0,0 +1,53 @@
+; unrle - unpack data included with .incbin_rle into external RAM.
+;
+;	.include "lib/unrle.asm"
+;
+; In:	r2 = offset of the packed data in its page (<NAME)
+;	r0 = destination address in external RAM
+; Out:	r0 = address after the last byte written
+; Uses:	a, r2, r3, one stack level plus the one of the call
+;
+; Packed bytes are read by calling unpack_get with their page offset
+; in a.  The program supplies it, in the page holding the data:
+;
+;	unpack_get:	movp a, @a
+;			ret
+;
+; Cycles:
+;	2		call
+;	12		end of data, with the return
+;	15 + 13 * N	block of N literal bytes
+;	27 + 5 * N	byte repeated N times
+;
+; Write "mov @r0, a" instead of "movx @r0, a" (and adjust the counts)
+; to unpack into internal RAM.
+
+unrle:
+	mov a, r2		; 1
+	call unpack_get		; 2 + 4
+	inc r2			; 1
+	jz unrle_end		; 2
+	jb7 unrle_run		; 2
+	mov r3, a		; 1	01..7F: literal bytes
+unrle_lit:
+	mov a, r2		; 1
+	call unpack_get		; 2 + 4
+	inc r2			; 1
+	movx @r0, a		; 2
+	inc r0			; 1
+	djnz r3, unrle_lit	; 2
+	jmp unrle		; 2
+unrle_run:
+	anl a, #0x7F		; 2	80..FF: repeat the next byte
+	add a, #3		; 2
+	mov r3, a		; 1
+	mov a, r2		; 1
+	call unpack_get		; 2 + 4
+	inc r2			; 1
+unrle_fill:
+	movx @r0, a		; 2
+	inc r0			; 1
+	djnz r3, unrle_fill	; 2
+	jmp unrle		; 2
+unrle_end:
+	ret			; 2
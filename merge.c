@@ -0,0 +1,360 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Data block merging (-d).  A data block is a run of .db, .dw,
+ * .incbin, .table ... bytes that starts at a label.  A block whose
+ * bytes also appear in an earlier block in the same page is dropped,
+ * and its labels are moved to the copy, so movp still reads it from
+ * the page its code expects.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asm48.h"
+#include "parse.tab.h"
+
+/*
+ * A data block: a run of data bytes and the markers of the labels
+ * among them, between code or .org filler.
+ */
+struct Block {
+	struct Section *sect;
+	struct Instruction *prev;	/* Instruction before first, or NULL. */
+	struct Instruction *first, *last;
+	struct Instruction *end;	/* After the markers that follow last. */
+	const char *name;		/* First label of the block. */
+	unsigned char *bytes;
+	int size;
+	int removed;
+};
+
+static struct Block *blocks;
+static int num_blocks, max_blocks;
+
+/*
+ * Get the bytes of a data instruction before it is assembled.
+ * Returns 0 if they aren't known yet.
+ */
+static int data_bytes(struct Instruction *ins, unsigned char *buf)
+{
+	const char *kind;
+	int value;
+
+	if (ins->expr == NULL) {
+		memcpy(buf, ins->buf, ins->size);
+		return 1;
+	}
+	kind = fixup_kind(ins);
+	if (kind == NULL || !expr_is_defined(ins->expr) || expr_refers_to_label(ins->expr))
+		return 0;
+	value = eval_expr(ins->cur_file, ins->expr);
+	if (strcmp(kind, "db") == 0) {
+		buf[0] = value;
+		return 1;
+	}
+	if (strcmp(kind, "dw") == 0) {
+		buf[0] = value & 0xFF;
+		buf[1] = value >> 8;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Collect the data block starting at a marker that follows code,
+ * filler or the start of the section.  Returns the instruction
+ * after the block.
+ */
+static struct Instruction *collect_block(struct Section *sect, struct Instruction *prev, struct Instruction *first)
+{
+	struct Block *b;
+	struct Instruction *ins, *last = NULL, *end;
+	const char *name = NULL;
+	unsigned char *bytes;
+	int size = 0, ok = 1;
+
+	for (ins = first; ins != NULL && (ins->type == INS_LABEL || ins->type == INS_DATA); ins = ins->next) {
+		if (ins->type == INS_DATA) {
+			size += ins->size;
+			last = ins;
+		} else if (name == NULL && ins->sym != NULL && size == 0) {
+			name = ins->sym->name;
+		}
+	}
+	end = ins;
+	if (size == 0 || name == NULL)
+		return end;
+
+	bytes = malloc(size);
+	if (bytes == NULL)
+		err_printf("Unable to allocate data block\n");
+	size = 0;
+	for (ins = first; ins != last->next; ins = ins->next) {
+		if (ins->type != INS_DATA)
+			continue;
+		if (!data_bytes(ins, bytes + size))
+			ok = 0;
+		size += ins->size;
+	}
+	if (!ok) {
+		free(bytes);
+		return end;
+	}
+
+	if (num_blocks == max_blocks) {
+		max_blocks = max_blocks ? max_blocks * 2 : 64;
+		blocks = realloc(blocks, max_blocks * sizeof(struct Block));
+		if (blocks == NULL)
+			err_printf("Unable to allocate data blocks\n");
+	}
+	b = &blocks[num_blocks++];
+	b->sect = sect;
+	b->prev = prev;
+	b->first = first;
+	b->last = last;
+	b->end = end;
+	b->name = name;
+	b->bytes = bytes;
+	b->size = size;
+	b->removed = 0;
+	return end;
+}
+
+/*
+ * Start address of a block.
+ */
+static int block_addr(struct Block *b)
+{
+	return b->first->offset;
+}
+
+/*
+ * Will two blocks stay in the same page however the sections are
+ * placed after merging?
+ */
+static int same_page(struct Block *a, struct Block *b)
+{
+	int page = block_addr(a) & PAGE_MASK;
+
+	if (((block_addr(a) + a->size - 1) & PAGE_MASK) != page
+			|| (block_addr(b) & PAGE_MASK) != page
+			|| ((block_addr(b) + b->size - 1) & PAGE_MASK) != page
+			|| a->sect->rom_bank != b->sect->rom_bank)
+		return 0;
+	if (!a->sect->reloc && !b->sect->reloc)
+		return 1;
+	if (a->sect == b->sect && a->sect->in_page)
+		return 1;
+	return a->sect->page >= 0 && a->sect->page == b->sect->page;
+}
+
+/*
+ * Find where the bytes of b start inside a, or -1.
+ */
+static int find_in(struct Block *a, struct Block *b)
+{
+	int i;
+
+	for (i = 0; i + b->size <= a->size; i++) {
+		if (memcmp(a->bytes + i, b->bytes, b->size) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Find the data instruction of block a that holds offset pos.
+ * Sets *inside to the offset of pos within it.
+ */
+static struct Instruction *data_at(struct Block *a, int pos, int *inside)
+{
+	struct Instruction *ins;
+	int offset = 0;
+
+	for (ins = a->first; ; ins = ins->next) {
+		if (ins->type != INS_DATA)
+			continue;
+		if (offset + ins->size > pos)
+			break;
+		offset += ins->size;
+	}
+	*inside = pos - offset;
+	return ins;
+}
+
+/*
+ * Can a marker go at offset pos of block a?  Only raw bytes can
+ * be split in two.
+ */
+static int can_mark(struct Block *a, int pos)
+{
+	int inside;
+	struct Instruction *ins;
+
+	if (pos == a->size)
+		return 1;
+	ins = data_at(a, pos, &inside);
+	return inside == 0 || ins->expr == NULL;
+}
+
+/*
+ * Put a marker at offset pos of block a, after the markers
+ * already there.
+ */
+static void insert_mark(struct Block *a, int pos, struct Instruction *mark)
+{
+	struct Instruction *ins, *rest, *before;
+	int inside;
+
+	if (pos == a->size) {
+		/* After the data, and the markers already there. */
+		for (before = a->last; before->next != NULL && before->next->type == INS_LABEL; before = before->next)
+			;
+		mark->next = before->next;
+		before->next = mark;
+		mark->section = a->sect;
+		if (a->sect->tail == before)
+			a->sect->tail = mark;
+		return;
+	}
+	ins = data_at(a, pos, &inside);
+	if (inside > 0) {
+		rest = allocate_instruction(0, ins->offset + inside);
+		rest->type = INS_DATA;
+		rest->buf = ins->buf + inside;
+		rest->size = ins->size - inside;
+		rest->src_line = ins->src_line;
+		rest->cur_file = ins->cur_file;
+		rest->section = ins->section;
+		rest->next = ins->next;
+		ins->next = rest;
+		ins->size = inside;
+		if (a->last == ins)
+			a->last = rest;
+		if (a->sect->tail == ins)
+			a->sect->tail = rest;
+		before = ins;
+	} else {
+		for (before = a->first; before->next != ins; before = before->next)
+			;
+	}
+	mark->next = before->next;
+	before->next = mark;
+	mark->section = a->sect;
+}
+
+/*
+ * Drop the data of block b and move its markers to the same bytes
+ * at offset pos of block a.  The markers right after the data (an
+ * end label, say) move to the end of the copy, so lengths stay
+ * right; but not when code follows, which they may label too.
+ * Returns 0 if nothing was changed.
+ */
+static int merge_block(struct Block *a, struct Block *b, int pos)
+{
+	struct Instruction *ins, *next, *end = b->end;
+	int offset = 0;
+
+	if (b->last->next != end && end != NULL && end->type == INS_CODE)
+		return 0;
+	for (ins = b->first; ins != end; ins = ins->next) {
+		if (ins->type == INS_DATA)
+			offset += ins->size;
+		else if (!can_mark(a, pos + offset))
+			return 0;
+	}
+
+	if (b->prev != NULL)
+		b->prev->next = end;
+	else
+		b->sect->head = end;
+	if (end == NULL)
+		b->sect->tail = b->prev;
+
+	offset = 0;
+	for (ins = b->first; ins != end; ins = next) {
+		next = ins->next;
+		if (ins->type == INS_DATA)
+			offset += ins->size;
+		else
+			insert_mark(a, pos + offset, ins);
+	}
+	b->removed = 1;
+	return 1;
+}
+
+/*
+ * Merge the data blocks of the laid out program, and print the
+ * blocks dropped and the bytes saved.
+ */
+void merge_data(void)
+{
+	struct Section *sect;
+	struct Instruction *ins, *prev, *next;
+	int i, j, pos, saved = 0;
+
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		prev = NULL;
+		for (ins = sect->head; ins != NULL; ins = next) {
+			if (ins->type == INS_LABEL) {
+				next = collect_block(sect, prev, ins);
+			} else if (ins->type == INS_DATA) {
+				/* Data that starts without a label. */
+				for (next = ins; next != NULL && (next->type == INS_DATA || next->type == INS_LABEL); next = next->next)
+					;
+			} else {
+				next = ins->next;
+			}
+			for (prev = ins; prev->next != next; prev = prev->next)
+				;
+		}
+	}
+
+	printf("   Data merging:\n");
+	for (i = 0; i < num_blocks; i++) {
+		for (j = 0; j < i; j++) {
+			if (blocks[j].removed || !same_page(&blocks[j], &blocks[i]))
+				continue;
+			pos = find_in(&blocks[j], &blocks[i]);
+			if (pos >= 0 && merge_block(&blocks[j], &blocks[i], pos)) {
+				printf("   %-24s -> %s+%d, %4d bytes saved\n",
+					blocks[i].name, blocks[j].name, pos, blocks[i].size);
+				saved += blocks[i].size;
+				break;
+			}
+		}
+	}
+	printf("   %d bytes saved\n", saved);
+
+	for (i = 0; i < num_blocks; i++)
+		free(blocks[i].bytes);
+	free(blocks);
+	blocks = NULL;
+	num_blocks = max_blocks = 0;
+}
@@ -0,0 +1,511 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "parse.tab.h"
+#include "asm48.h"
+
+/*
+ * Object files are line-oriented text:
+ *
+ *   OBJECT48 <version>
+ *   FILE <source file name>
+ *   BANK <n> <file offset>			ROM bank placed by .bank
+ *   SECTION <name> <abs|rel> [bank <n>] [inpage] [page <n>] [with <name>]
+ *   DATA <c|d> <hex bytes>			code or data bytes
+ *   FILL <target offset> <fill byte>		.org filler
+ *   MARK <id>					label or .here position
+ *   FIX <kind> <c|d> <line> <hex bytes> <expr>	operand resolved at link time
+ *   LOOP <min> <max>				.loop bounds of the last instruction
+ *   LABEL <name> <mark id>			exported label
+ *   EQU <name> <value>				exported constant
+ *   EQUX <name> <expr>				exported constant that refers to labels
+ *   CYCLES <name> <op> <n> <begin> <end> <line>	.cycles_begin/.cycles_end check
+ *   RAM <name> <size> <mark id> <line>		.ram variable
+ *   END
+ *
+ * Fixup expressions are written in postfix: n<int> is a number,
+ * m<id> a marked position, s<name> an imported symbol (o<name> if
+ * it may be undefined), u<op> and b<op> unary and binary operators.
+ */
+
+#define OBJECT_VERSION 1
+#define DATA_CHUNK 32		/* Bytes per DATA record. */
+#define MAX_LINE 4096
+#define MAX_EXPR_DEPTH 64
+
+/*
+ * Operator characters used in object files.  Most
+ * operators are already stored as characters.
+ */
+static int op_char(int op)
+{
+	switch (op) {
+		case LSHIFT:	return '{';
+		case RSHIFT:	return '}';
+		case UMINUS:	return '-';
+		case UNOTLOGIC:	return '~';
+		case ULOW:	return '<';
+		case UHIGH:	return '>';
+	}
+	return op;
+}
+
+static int char_op(int ch, int unary)
+{
+	if (unary) {
+		switch (ch) {
+			case '-':	return UMINUS;
+			case '~':	return UNOTLOGIC;
+			case '<':	return ULOW;
+			case '>':	return UHIGH;
+		}
+		return -1;
+	}
+	switch (ch) {
+		case '{':	return LSHIFT;
+		case '}':	return RSHIFT;
+	}
+	return ch;
+}
+
+/*
+ * Return nonzero if the operand of an instruction must
+ * be resolved by the linker.  Page-local jumps inside a
+ * relocatable section are always left to the linker, which
+ * knows where the page boundaries fall.  So is every operand
+ * that refers to a label, even in an absolute section: -O, -u,
+ * -d, -m and -r may still move code at link time, and strip
+ * follows these references to keep what they use.
+ */
+int is_fixup(struct Instruction *ins)
+{
+	const char *kind = fixup_kind(ins);
+
+	if (kind == NULL)
+		return 0;
+	if (ins->section->reloc && strcmp(kind, "j8") == 0)
+		return 1;
+	return expr_needs_fixup(ins->expr) || expr_refers_to_label(ins->expr);
+}
+
+/*
+ * Write an expression in postfix form.
+ */
+static void write_expr(FILE *fp, struct Expr *expr)
+{
+	struct Symbol *sym;
+
+	switch (expr->op) {
+		case INT_VALUE:
+			fprintf(fp, " n%d", expr->value);
+			return;
+
+		case IDENTIFIER:
+			if (expr->mark != NULL) {
+				fprintf(fp, " m%d", expr->mark->value);
+				return;
+			}
+			sym = lookup_symbol(expr->sym);
+			if (sym == NULL)
+				fprintf(fp, " %c%s", expr->mustexist ? 's' : 'o', expr->sym);
+			else if (sym->expr != NULL)
+				write_expr(fp, sym->expr);
+			else if (sym->ins != NULL)
+				fprintf(fp, " m%d", sym->ins->value);
+			else
+				fprintf(fp, " n%d", sym->value);
+			return;
+
+		case UMINUS:
+		case UNOTLOGIC:
+		case ULOW:
+		case UHIGH:
+			write_expr(fp, expr->left);
+			fprintf(fp, " u%c", op_char(expr->op));
+			return;
+	}
+
+	write_expr(fp, expr->left);
+	write_expr(fp, expr->right);
+	fprintf(fp, " b%c", op_char(expr->op));
+}
+
+/*
+ * Write bytes as hex digits.
+ */
+static void write_hex(FILE *fp, const unsigned char *buf, int size)
+{
+	int i;
+	for (i = 0; i < size; i++)
+		fprintf(fp, "%02X", buf[i]);
+}
+
+/*
+ * Write the assembled module as a relocatable object file.
+ */
+void write_object(const char *filename)
+{
+	struct Section *sect;
+	struct Instruction *ins;
+	struct Symbol *sym;
+	struct CycleCheck *check;
+	struct RamVar *var;
+	const char *file = NULL;
+	int i, n;
+	FILE *fp = fopen(filename, "w");
+
+	if (fp == NULL)
+		err_printf("Couldn't open %s for output: %s\n", filename, strerror(errno));
+
+	fprintf(fp, "; *** asm48 v" VERSION " object ***\n");
+	fprintf(fp, "OBJECT48 %d\n", OBJECT_VERSION);
+
+	for (i = 0; i < MAX_ROM_BANKS; i++) {
+		if (rom_bank_offset[i] >= 0)
+			fprintf(fp, "BANK %d %d\n", i, rom_bank_offset[i]);
+	}
+
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		if (sect->head == NULL)
+			continue;
+		fprintf(fp, "SECTION %s %s", sect->name, sect->reloc ? "rel" : "abs");
+		if (sect->rom_bank > 0)
+			fprintf(fp, " bank %d", sect->rom_bank);
+		if (sect->in_page)
+			fprintf(fp, " inpage");
+		if (sect->page >= 0)
+			fprintf(fp, " page %d", sect->page);
+		if (sect->with != NULL)
+			fprintf(fp, " with %s", sect->with);
+		fprintf(fp, "\n");
+		for (ins = sect->head; ins != NULL; ins = ins->next) {
+			if (file == NULL || strcmp(file, ins->cur_file) != 0) {
+				file = ins->cur_file;
+				fprintf(fp, "FILE %s\n", file);
+			}
+			switch (ins->type) {
+				case INS_LABEL:
+					fprintf(fp, "MARK %d\n", ins->value);
+					break;
+
+				case INS_FILL:
+					fprintf(fp, "FILL %d %d\n", ins->value, ins->buf[0]);
+					break;
+
+				default:
+					if (is_fixup(ins)) {
+						fprintf(fp, "FIX %s %c %d ", fixup_kind(ins),
+							ins->type == INS_CODE ? 'c' : 'd', ins->src_line);
+						write_hex(fp, ins->buf, ins->size);
+						write_expr(fp, ins->expr);
+						fprintf(fp, "\n");
+					} else {
+						for (i = 0; i < ins->size; i += n) {
+							n = ins->size - i < DATA_CHUNK ? ins->size - i : DATA_CHUNK;
+							fprintf(fp, "DATA %c ", ins->type == INS_CODE ? 'c' : 'd');
+							write_hex(fp, ins->buf + i, n);
+							fprintf(fp, "\n");
+						}
+					}
+					if (ins->loop_max >= 0)
+						fprintf(fp, "LOOP %d %d\n", ins->loop_min, ins->loop_max);
+					break;
+			}
+		}
+	}
+
+	for (sym = first_symbol(); sym != NULL; sym = sym->next) {
+		if (!(sym->flags & SYMF_EXPORT))
+			continue;
+		if (sym->ins != NULL) {
+			fprintf(fp, "LABEL %s %d\n", sym->name, sym->ins->value);
+		} else if (sym->expr != NULL) {
+			fprintf(fp, "EQUX %s", sym->name);
+			write_expr(fp, sym->expr);
+			fprintf(fp, "\n");
+		} else {
+			fprintf(fp, "EQU %s %d\n", sym->name, sym->value);
+		}
+	}
+
+	for (check = cycle_checks; check != NULL; check = check->next) {
+		if (check->end != NULL)
+			fprintf(fp, "CYCLES %s %c %d %d %d %d\n", check->name, check->op, check->cycles,
+				check->begin->value, check->end->value, check->line_num);
+	}
+
+	for (var = ram_vars; var != NULL; var = var->next)
+		fprintf(fp, "RAM %s %d %d %d\n", var->name, var->size, var->mark->value, var->line_num);
+
+	fprintf(fp, "END\n");
+	fclose(fp);
+}
+
+/*
+ * Position markers of the object file being read, by id.
+ * Fixups may refer to a marker before it is reached.
+ */
+static struct Instruction **marks;
+static int num_marks;
+
+static struct Instruction *get_mark(int id)
+{
+	int n = num_marks;
+
+	if (id < 0)
+		err_printf("[%s] Invalid marker id %d\n", cur_file, id);
+	if (id >= num_marks) {
+		while (num_marks <= id)
+			num_marks = num_marks ? num_marks * 2 : 256;
+		marks = realloc(marks, num_marks * sizeof(*marks));
+		if (marks == NULL)
+			err_printf("Unable to allocate object markers\n");
+		memset(marks + n, 0, (num_marks - n) * sizeof(*marks));
+	}
+	if (marks[id] == NULL) {
+		marks[id] = allocate_instruction(0, 0);
+		marks[id]->type = INS_LABEL;
+		marks[id]->value = id;
+	}
+	return marks[id];
+}
+
+/*
+ * Decode size bytes of hex digits into buf.
+ */
+static void read_hex(const char *hex, unsigned char *buf, int size)
+{
+	unsigned int byte;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		if (sscanf(hex + i * 2, "%2x", &byte) != 1)
+			err_printf("[%s] Invalid hex data in object file\n", cur_file);
+		buf[i] = byte;
+	}
+}
+
+/*
+ * Rebuild a fixup expression from its postfix form,
+ * given as whitespace separated tokens.
+ */
+static struct Expr *read_expr(char *tokens, int line_num)
+{
+	struct Expr *stack[MAX_EXPR_DEPTH], *left;
+	int depth = 0, op;
+	char *tok;
+
+	for (tok = strtok(tokens, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+		if (depth >= MAX_EXPR_DEPTH)
+			err_printf("[%s] Line %d: Fixup expression too deep\n", cur_file, line_num);
+		switch (tok[0]) {
+			case 'n':
+				stack[depth++] = mk_const_expr(atoi(tok + 1), line_num);
+				break;
+			case 'm':
+				stack[depth] = mk_symbolic_expr("(label)", line_num, 1);
+				stack[depth++]->mark = get_mark(atoi(tok + 1));
+				break;
+			case 's':
+			case 'o':
+				stack[depth++] = mk_symbolic_expr(dup_str(tok + 1), line_num, tok[0] == 's');
+				break;
+			case 'u':
+				op = char_op(tok[1], 1);
+				if (depth < 1 || op < 0)
+					err_printf("[%s] Line %d: Invalid fixup expression\n", cur_file, line_num);
+				stack[depth - 1] = mk_unary_expr(op, stack[depth - 1], line_num);
+				break;
+			case 'b':
+				if (depth < 2)
+					err_printf("[%s] Line %d: Invalid fixup expression\n", cur_file, line_num);
+				left = stack[depth - 2];
+				stack[depth - 2] = mk_binary_expr(char_op(tok[1], 0), left, stack[depth - 1], line_num);
+				depth--;
+				break;
+			default:
+				err_printf("[%s] Line %d: Invalid fixup expression\n", cur_file, line_num);
+		}
+	}
+
+	if (depth != 1)
+		err_printf("[%s] Line %d: Invalid fixup expression\n", cur_file, line_num);
+	return stack[0];
+}
+
+/*
+ * Read the placement constraints at the end of a SECTION record.
+ */
+static void read_constraints(struct Section *sect, char *p)
+{
+	char *tok, *arg;
+
+	for (tok = strtok(p, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+		if (strcmp(tok, "inpage") == 0) {
+			sect->in_page = 1;
+			continue;
+		}
+		arg = strtok(NULL, " \t\r\n");
+		if (arg == NULL)
+			err_printf("[%s] Invalid section record\n", cur_file);
+		if (strcmp(tok, "bank") == 0 && atoi(arg) >= 0 && atoi(arg) < MAX_ROM_BANKS) {
+			sect->rom_bank = atoi(arg);
+			sect->base = sect->rom_bank * MAX_ADDR;
+		} else if (strcmp(tok, "page") == 0)
+			sect->page = atoi(arg);
+		else if (strcmp(tok, "with") == 0)
+			sect->with = dup_str(arg);
+		else
+			err_printf("[%s] Invalid section record\n", cur_file);
+	}
+}
+
+/*
+ * Read a relocatable object file for linking.
+ * Each of its sections becomes a new section of the image.
+ */
+void read_object(const char *filename)
+{
+	char line[MAX_LINE], word[MAX_LINE], kind[16], hex[MAX_LINE];
+	char type;
+	int value, fill, line_num, size, pos, min;
+	struct Instruction *ins;
+	struct Symbol *sym;
+	FILE *fp = fopen(filename, "r");
+
+	if (fp == NULL)
+		err_printf("Couldn't open object file %s: %s\n", filename, strerror(errno));
+
+	cur_file_set(filename);
+	num_marks = 0;
+	free(marks);
+	marks = NULL;
+
+	if (fgets(line, sizeof(line), fp) == NULL || fgets(line, sizeof(line), fp) == NULL
+	    || sscanf(line, "OBJECT48 %d", &value) != 1)
+		err_printf("[%s] Not an asm48 object file\n", cur_file);
+	if (value != OBJECT_VERSION)
+		err_printf("[%s] Unsupported object file version %d\n", cur_file, value);
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (line[0] == ';' || sscanf(line, "%s", word) != 1)
+			continue;
+
+		if (strcmp(word, "END") == 0) {
+			break;
+		} else if (strcmp(word, "FILE") == 0) {
+			if (sscanf(line, "FILE %s", word) == 1)
+				cur_file_set(word);
+		} else if (strcmp(word, "BANK") == 0) {
+			if (sscanf(line, "BANK %d %d", &value, &fill) != 2 || value < 0 || value >= MAX_ROM_BANKS)
+				err_printf("[%s] Invalid bank record\n", cur_file);
+			if (rom_bank_offset[value] >= 0 && rom_bank_offset[value] != fill)
+				error_at(cur_file, 0, 0, "ROM bank %d is already at file offset %d", value, rom_bank_offset[value]);
+			else
+				rom_bank_offset[value] = fill;
+		} else if (strcmp(word, "SECTION") == 0) {
+			if (sscanf(line, "SECTION %s %15s %n", word, kind, &pos) != 2)
+				err_printf("[%s] Invalid section record\n", cur_file);
+			cur_section->end = cur_offset;
+			cur_section = create_section(word, strcmp(kind, "rel") == 0);
+			cur_offset = 0;
+			read_constraints(cur_section, line + pos);
+		} else if (strcmp(word, "DATA") == 0) {
+			if (sscanf(line, "DATA %c %s", &type, hex) != 2)
+				err_printf("[%s] Invalid data record\n", cur_file);
+			size = strlen(hex) / 2;
+			ins = allocate_instruction(size, cur_offset);
+			read_hex(hex, ins->buf, size);
+			ins->type = type == 'c' ? INS_CODE : INS_DATA;
+			append(ins);
+		} else if (strcmp(word, "FILL") == 0) {
+			if (sscanf(line, "FILL %d %d", &value, &fill) != 2)
+				err_printf("[%s] Invalid fill record\n", cur_file);
+			append(orgfill(value, fill, -1));
+		} else if (strcmp(word, "MARK") == 0) {
+			if (sscanf(line, "MARK %d", &value) != 1)
+				err_printf("[%s] Invalid marker record\n", cur_file);
+			ins = get_mark(value);
+			ins->offset = cur_offset;
+			ins->cur_file = cur_file;
+			append(ins);
+		} else if (strcmp(word, "FIX") == 0) {
+			if (sscanf(line, "FIX %15s %c %d %s %n", kind, &type, &line_num, hex, &pos) != 4)
+				err_printf("[%s] Invalid fixup record\n", cur_file);
+			size = strlen(hex) / 2;
+			ins = fixup_ins(kind, size, read_expr(line + pos, line_num));
+			read_hex(hex, ins->buf, size);
+			ins->type = type == 'c' ? INS_CODE : INS_DATA;
+			ins->src_line = line_num;
+			append(ins);
+		} else if (strcmp(word, "LOOP") == 0) {
+			if (sscanf(line, "LOOP %d %d", &min, &value) != 2 || cur_section->tail == NULL)
+				err_printf("[%s] Invalid loop record\n", cur_file);
+			cur_section->tail->loop_min = min;
+			cur_section->tail->loop_max = value;
+		} else if (strcmp(word, "CYCLES") == 0) {
+			if (sscanf(line, "CYCLES %s %c %d %d %d %d", word, &type, &value, &min, &fill, &line_num) != 6)
+				err_printf("[%s] Invalid cycles record\n", cur_file);
+			add_cycle_check(word, get_mark(min), get_mark(fill), type, value, line_num);
+		} else if (strcmp(word, "RAM") == 0) {
+			if (sscanf(line, "RAM %s %d %d %d", word, &size, &value, &line_num) != 4)
+				err_printf("[%s] Invalid RAM record\n", cur_file);
+			add_ram_var(word, size, get_mark(value), line_num);
+		} else if (strcmp(word, "LABEL") == 0) {
+			if (sscanf(line, "LABEL %s %d", word, &value) != 2)
+				err_printf("[%s] Invalid label record\n", cur_file);
+			sym = define_symbol(word, 0, SYMB_LABEL);
+			if (sym != NULL) {
+				sym->flags |= SYMF_EXPORT;
+				sym->ins = get_mark(value);
+				sym->ins->sym = sym;
+			}
+		} else if (strcmp(word, "EQU") == 0) {
+			if (sscanf(line, "EQU %s %d", word, &value) != 2)
+				err_printf("[%s] Invalid constant record\n", cur_file);
+			sym = define_symbol(word, value, SYMB_CONST);
+			if (sym != NULL)
+				sym->flags |= SYMF_EXPORT;
+		} else if (strcmp(word, "EQUX") == 0) {
+			if (sscanf(line, "EQUX %s %n", word, &pos) != 1)
+				err_printf("[%s] Invalid constant record\n", cur_file);
+			sym = define_symbol(word, 0, SYMB_CONST);
+			if (sym != NULL) {
+				sym->flags |= SYMF_EXPORT;
+				sym->expr = read_expr(line + pos, 0);
+			}
+		} else {
+			err_printf("[%s] Unknown object file record %s\n", cur_file, word);
+		}
+	}
+
+	fclose(fp);
+}
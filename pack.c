@@ -0,0 +1,130 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Compressors for .incbin_rle and .incbin_lz.  Both formats are a
+ * sequence of blocks read by lib/unrle.asm and lib/unlz.asm, each
+ * starting with a control byte:
+ *
+ *   00         end of data
+ *   01..7F     that many literal bytes follow
+ *   80..FF     RLE: the next byte repeated (control & 7F) + 3 times
+ *              LZ: (control & 7F) + 3 bytes copied from the output,
+ *              starting the number of bytes back given by the next byte
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asm48.h"
+
+#define MAX_LITERALS	0x7F
+#define MIN_REPEAT	3
+#define MAX_REPEAT	(0x7F + MIN_REPEAT)
+#define MAX_DISTANCE	0xFF
+
+/*
+ * Write the literal bytes in[start..end) in as many blocks as needed.
+ * Returns the new output size.
+ */
+static int put_literals(const unsigned char *in, int start, int end, unsigned char *out, int n)
+{
+	int count;
+
+	while (start < end) {
+		count = end - start;
+		if (count > MAX_LITERALS)
+			count = MAX_LITERALS;
+		out[n++] = count;
+		memcpy(out + n, in + start, count);
+		n += count;
+		start += count;
+	}
+	return n;
+}
+
+/*
+ * Run-length encode size bytes of in into out, which must hold
+ * PACK_BOUND(size) bytes.  Returns the packed size.
+ */
+int pack_rle(const unsigned char *in, int size, unsigned char *out)
+{
+	int i = 0, lit = 0, run, n = 0;
+
+	while (i < size) {
+		for (run = 1; i + run < size && run < MAX_REPEAT && in[i + run] == in[i]; run++)
+			;
+		if (run < MIN_REPEAT) {
+			i++;
+			continue;
+		}
+		n = put_literals(in, lit, i, out, n);
+		out[n++] = 0x80 | (run - MIN_REPEAT);
+		out[n++] = in[i];
+		i += run;
+		lit = i;
+	}
+	n = put_literals(in, lit, size, out, n);
+	out[n++] = 0;
+	return n;
+}
+
+/*
+ * LZ encode size bytes of in into out, which must hold
+ * PACK_BOUND(size) bytes.  Each position takes the longest match
+ * within the last 255 bytes; matches may overlap the bytes they
+ * produce, so runs cost one match.  Returns the packed size.
+ */
+int pack_lz(const unsigned char *in, int size, unsigned char *out)
+{
+	int i = 0, lit = 0, j, len, best, best_len, n = 0;
+
+	while (i < size) {
+		best = 0;
+		best_len = 0;
+		for (j = (i > MAX_DISTANCE ? i - MAX_DISTANCE : 0); j < i; j++) {
+			for (len = 0; i + len < size && len < MAX_REPEAT && in[j + len] == in[i + len]; len++)
+				;
+			if (len >= best_len) {
+				best = j;
+				best_len = len;
+			}
+		}
+		if (best_len < MIN_REPEAT) {
+			i++;
+			continue;
+		}
+		n = put_literals(in, lit, i, out, n);
+		out[n++] = 0x80 | (best_len - MIN_REPEAT);
+		out[n++] = i - best;
+		i += best_len;
+		lit = i;
+	}
+	n = put_literals(in, lit, size, out, n);
+	out[n++] = 0;
+	return n;
+}
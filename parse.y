@@ -34,13 +34,16 @@
 void yyerror(const char *msg);
 int yylex(void);
 extern int lex_src_line;
-static int parse_src_line;
+int parse_src_line;
 
 int if_push_lex(int state);
 
 #define YYMAXDEPTH 1000000
 %}
 
+%locations
+%define parse.error verbose
+
 %token A BUS PSW C I TCNTI CLK T TCNT CNT
 %token<port_num> P0 P12 P47
 %token<reg_num> DEREF_REG GENERAL_REG 
@@ -57,7 +60,7 @@ int if_push_lex(int state);
 %token XRL
 
 %token IF IFDEF IFNDEF MESSAGE WARNING ERROR
-%token EQU SET ORG DB DW DBR INCBIN
+%token EQU SET ORG DB DW DBR INCBIN INCBIN_RLE INCBIN_LZ SECTION EXPORT LOOP CYCLES_BEGIN CYCLES_END JUMPTABLE TABLE RAM BANK
 %token LSHIFT RSHIFT MOD
 %token UMINUS UNOTLOGIC ULOW UHIGH
 %token EQUAL DIFF LESSTHAN GREATERTHAN LAND LOR
@@ -91,7 +94,7 @@ instruction_end:
 	;
 
 instruction :
-	  instruction_expr { ins_tail->src_line = parse_src_line; } instruction_end
+	  instruction_expr { cur_section->tail->src_line = parse_src_line; attach_loop_bound(cur_section->tail); } instruction_end
 	| if_directive instruction_end
 	| msg_directive instruction_end
 	| equate_directive instruction_end
@@ -100,12 +103,21 @@ instruction :
 	| dw_directive instruction_end
 	| dbr_directive instruction_end
 	| incbin_directive instruction_end
+	| section_directive instruction_end
+	| bank_directive instruction_end
+	| export_directive instruction_end
+	| loop_directive instruction_end
+	| cycles_directive instruction_end
+	| jumptable_directive instruction_end
+	| table_directive instruction_end
+	| ram_directive instruction_end
 	| label
 	| instruction_end
+	| error instruction_end		{ yyerrok; }
 	;
 
 label :
-	  IDENTIFIER ':'		{ define_symbol($1, cur_offset, SYMB_LABEL); }
+	  IDENTIFIER ':'		{ define_label($1); }
 	;
 
 if_directive :
@@ -117,8 +129,8 @@ if_directive :
 
 msg_directive :
 	  MESSAGE msg_directive_expr	{ printf("Message: %s\n", $2); }
-	| WARNING msg_directive_expr	{ warn_printf("[%s] Line %d: %s\n", cur_file, parse_src_line, $2); }
-	| ERROR msg_directive_expr	{ err_printf("[%s] Line %d: %s\n", cur_file, parse_src_line, $2); }
+	| WARNING msg_directive_expr	{ warning_at(cur_file, parse_src_line, 0, "%s", $2); }
+	| ERROR msg_directive_expr	{ error_at(cur_file, parse_src_line, 0, "%s", $2); }
 	;
 
 msg_directive_expr :
@@ -127,17 +139,17 @@ msg_directive_expr :
 	;
 
 equate_directive :
-	  EQU IDENTIFIER ',' expr	{ define_symbol($2, eval_expr(cur_file, $4), SYMB_CONST); }
-	| EQU IDENTIFIER expr		{ define_symbol($2, eval_expr(cur_file, $3), SYMB_CONST); }
-	| EQU IDENTIFIER		{ define_symbol($2, 1, SYMB_CONST); }
-	| SET IDENTIFIER ',' expr	{ redefine_symbol($2, eval_expr(cur_file, $4), SYMB_CONST); }
-	| SET IDENTIFIER expr		{ redefine_symbol($2, eval_expr(cur_file, $3), SYMB_CONST); }
-	| SET IDENTIFIER		{ redefine_symbol($2, 1, SYMB_CONST); }
+	  EQU IDENTIFIER ',' expr	{ define_equate($2, $4, 0); }
+	| EQU IDENTIFIER expr		{ define_equate($2, $3, 0); }
+	| EQU IDENTIFIER		{ define_equate($2, NULL, 0); }
+	| SET IDENTIFIER ',' expr	{ define_equate($2, $4, 1); }
+	| SET IDENTIFIER expr		{ define_equate($2, $3, 1); }
+	| SET IDENTIFIER		{ define_equate($2, NULL, 1); }
 	;
 
 org_directive :
-	  ORG expr		{ append_nostat(org(eval_expr(cur_file, $2), parse_src_line)); }
-	| ORG expr ',' expr	{ append_nostat(orgfill(eval_expr(cur_file, $2), eval_expr(cur_file, $4), parse_src_line)); }
+	  ORG expr		{ append(org(eval_expr(cur_file, $2), parse_src_line)); }
+	| ORG expr ',' expr	{ append(orgfill(eval_expr(cur_file, $2), eval_expr(cur_file, $4), parse_src_line)); }
 	;
 
 db_directive :
@@ -167,8 +179,63 @@ dbr_directive_expr :
 	| expr				{ append(dbr(eval_expr(cur_file, $1), parse_src_line)); }
 	;
 
+jumptable_directive :
+	  JUMPTABLE jumptable_list
+	;
+
+jumptable_list :
+	  jumptable_list ',' expr	{ append(jump_table_entry($3, parse_src_line)); }
+	| expr				{ append(jump_table_entry($1, parse_src_line)); }
+	;
+
+table_directive :
+	  TABLE expr ',' expr			{ table(eval_expr(cur_file, $2), $4, 1, 0, 0, 0, parse_src_line); }
+	| TABLE expr ',' expr ',' expr		{ table(eval_expr(cur_file, $2), $4, eval_expr(cur_file, $6), 0, 0, 0, parse_src_line); }
+	| TABLE expr ',' expr ',' expr ',' expr ',' expr
+						{ table(eval_expr(cur_file, $2), $4, eval_expr(cur_file, $6), 1,
+							eval_expr(cur_file, $8), eval_expr(cur_file, $10), parse_src_line); }
+	;
+
+ram_directive :
+	  RAM IDENTIFIER ',' expr	{ ram_var($2, eval_expr(cur_file, $4), parse_src_line); }
+	;
+
 incbin_directive :
 	  INCBIN STRING_LITERAL		{ append(incbin($2, parse_src_line)); }
+	| INCBIN_RLE IDENTIFIER ',' STRING_LITERAL	{ append(incbin_packed($2, $4, PACK_RLE, parse_src_line)); }
+	| INCBIN_LZ IDENTIFIER ',' STRING_LITERAL	{ append(incbin_packed($2, $4, PACK_LZ, parse_src_line)); }
+	;
+
+bank_directive :
+	  BANK expr			{ select_rom_bank(eval_expr(cur_file, $2), -1, parse_src_line); }
+	| BANK expr ',' expr		{ select_rom_bank(eval_expr(cur_file, $2), eval_expr(cur_file, $4), parse_src_line); }
+	;
+
+section_directive :
+	  SECTION IDENTIFIER		{ select_section($2); }
+	| SECTION IDENTIFIER ',' IDENTIFIER		{ select_section($2); constrain_section($4, NULL, parse_src_line); }
+	| SECTION IDENTIFIER ',' IDENTIFIER expr	{ select_section($2); constrain_section($4, $5, parse_src_line); }
+	;
+
+export_directive :
+	  EXPORT export_list
+	;
+
+export_list :
+	  export_list ',' IDENTIFIER	{ export_symbol($3, parse_src_line); }
+	| IDENTIFIER			{ export_symbol($1, parse_src_line); }
+	;
+
+loop_directive :
+	  LOOP expr			{ set_loop_bound(0, eval_expr(cur_file, $2), parse_src_line); }
+	| LOOP expr ',' expr		{ set_loop_bound(eval_expr(cur_file, $2), eval_expr(cur_file, $4), parse_src_line); }
+	;
+
+cycles_directive :
+	  CYCLES_BEGIN IDENTIFIER			{ cycles_begin($2, parse_src_line); }
+	| CYCLES_END IDENTIFIER ',' EQUAL expr		{ cycles_end($2, '=', eval_expr(cur_file, $5), parse_src_line); }
+	| CYCLES_END IDENTIFIER ',' LESSTHAN expr	{ cycles_end($2, '<', eval_expr(cur_file, $5), parse_src_line); }
+	| CYCLES_END IDENTIFIER ',' GREATERTHAN expr	{ cycles_end($2, '>', eval_expr(cur_file, $5), parse_src_line); }
 	;
 
 instruction_expr :
@@ -204,7 +271,7 @@ instruction_expr :
 	| INC A				{ append(ins1(0x17)); }
 	| INC any_reg			{ append(reg_ins(0x18, $2)); }
 	| INC '@' DEREF_REG		{ append(deref_ins(0x10, $3)); }
-	| IN A ',' P0			{ append(ins1(0x08)); } /* FIXME: is this right? Manual doesn't list opcode!??? */
+	| IN A ',' P0			{ append(ins1(0x08)); } /* 8021: shares the opcode of INS A,BUS */
 	| INS A ',' BUS			{ append(ins1(0x08)); }
 	| JB address			{ append(jb_ins($1, $2)); }
 	| JC address			{ append(j8_ins(0xF6, $2)); }
@@ -245,7 +312,7 @@ instruction_expr :
 	| ORL BUS ',' imm_val		{ append(imm_ins(0x88, $4)); }
 	| ORL P12 ',' imm_val		{ append(port_imm_ins(0x88, $2, $4)); }
 	| ORLD P47 ',' A		{ append(port_ins(0x8C, $2)); }
-	| OUTL P0 ',' A			{ append(ins1(0x90)); }
+	| OUTL P0 ',' A			{ append(ins1(0x90)); } /* 8021: shares the opcode of MOVX @R0,A */
 	| OUTL BUS ',' A		{ append(ins1(0x02)); }
 	| OUTL P12 ',' A		{ append(port_ins(0x38, $2)); }
 	| RET				{ append(ins1(0x83)); }
@@ -344,8 +411,8 @@ additive_expr :
 mult_expr :
 	  unary_expr
 	| mult_expr '*' unary_expr { $$ = mk_binary_expr('*', $1, $3, parse_src_line); }
-	| mult_expr '/' unary_expr { $$ = mk_binary_expr('/', $1, $3, parse_src_line); }
-	| mult_expr MOD unary_expr { $$ = mk_binary_expr('%', $1, $3, parse_src_line); }
+	| mult_expr '/' unary_expr { $$ = mk_binary_expr('/', $1, $3, parse_src_line); $$->column = @2.first_column; }
+	| mult_expr MOD unary_expr { $$ = mk_binary_expr('%', $1, $3, parse_src_line); $$->column = @2.first_column; }
 	;
 
 unary_expr :
@@ -365,10 +432,10 @@ unary_expr :
  *     MOV A, ABh
  */
 primary_expr :
-	  IDENTIFIER { $$ = mk_symbolic_expr($1, parse_src_line, 1); }
-	| '#' IDENTIFIER { $$ = mk_symbolic_expr($2, parse_src_line, 1); }
-	| '@' IDENTIFIER { $$ = mk_symbolic_expr($2, parse_src_line, 0); }
-	| '#' '@' IDENTIFIER { $$ = mk_symbolic_expr($3, parse_src_line, 0); }
+	  IDENTIFIER { $$ = mk_symbolic_expr($1, parse_src_line, 1); $$->column = @1.first_column; }
+	| '#' IDENTIFIER { $$ = mk_symbolic_expr($2, parse_src_line, 1); $$->column = @2.first_column; }
+	| '@' IDENTIFIER { $$ = mk_symbolic_expr($2, parse_src_line, 0); $$->column = @2.first_column; }
+	| '#' '@' IDENTIFIER { $$ = mk_symbolic_expr($3, parse_src_line, 0); $$->column = @3.first_column; }
 	| INT_VALUE { $$ = mk_const_expr($1, parse_src_line); }
 	| '#' INT_VALUE { $$ = mk_const_expr($2, parse_src_line); }
 	| '(' expr ')' { $$ = $2; }
@@ -378,5 +445,5 @@ primary_expr :
 
 void yyerror(const char *msg)
 {
-	err_printf("[%s] Line %d: %s\n", cur_file, parse_src_line, msg);
+	error_at(cur_file, yylloc.first_line, yylloc.first_column, "%s", msg);
 }
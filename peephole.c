@@ -0,0 +1,245 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Peephole optimizer (-O).  Rewrites short instruction sequences of
+ * the laid out program into shorter or faster equivalents, and lays
+ * the program out again until nothing more changes.  Code inside a
+ * .cycles_begin/.cycles_end block is left alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asm48.h"
+
+/* Optimization passes before the optimizer gives up. */
+#define MAX_OPT_PASSES 16
+
+/* Opcodes the rules look for. */
+#define OP_MOV_A_IMM	0x23
+#define OP_CLR_A	0x27
+#define OP_RET		0x83
+#define OP_MOV_PSW_A	0xD7
+#define OP_SEL_RB0	0xC5
+#define OP_SEL_RB1	0xD5
+#define OP_SEL_MB0	0xE5
+#define OP_SEL_MB1	0xF5
+#define OP_JTF		0x16
+
+/* Rules, and what each has saved. */
+#define RULE_CLR	0
+#define RULE_TAIL_CALL	1
+#define RULE_SEL	2
+#define RULE_JUMP_NEXT	3
+#define NUM_RULES	4
+
+static struct {
+	const char *name;
+	int count, bytes, cycles;
+} rules[NUM_RULES] = {
+	{ "mov a,#0 -> clr a" },
+	{ "call x; ret -> jmp x" },
+	{ "redundant sel rb/mb" },
+	{ "jump to next instruction" },
+};
+
+/*
+ * Count what a rule saved by replacing the instruction old_ins.
+ */
+static void saved(int rule, struct Instruction *old_ins, struct Instruction *new_ins)
+{
+	rules[rule].count++;
+	rules[rule].bytes += old_ins->size - (new_ins != NULL ? new_ins->size : 0);
+	rules[rule].cycles += instruction_cycles(old_ins->buf, old_ins->size)
+		- (new_ins != NULL ? instruction_cycles(new_ins->buf, new_ins->size) : 0);
+}
+
+/*
+ * Unlink an instruction from its section; prev is the one
+ * before it, or NULL.
+ */
+static void unlink_ins(struct Section *sect, struct Instruction *prev, struct Instruction *ins)
+{
+	if (prev != NULL)
+		prev->next = ins->next;
+	else
+		sect->head = ins->next;
+	if (sect->tail == ins)
+		sect->tail = prev;
+}
+
+/*
+ * Update the number of timed blocks open at a marker.
+ */
+static int timed_depth(struct Instruction *ins, int depth)
+{
+	struct CycleCheck *check;
+
+	for (check = cycle_checks; check != NULL; check = check->next) {
+		if (check->begin == ins)
+			depth++;
+		if (check->end == ins)
+			depth--;
+	}
+	return depth;
+}
+
+/*
+ * Is an instruction a MOV A,#0?
+ */
+static int is_clear_a(struct Instruction *ins)
+{
+	if (ins->size != 2 || ins->buf[0] != OP_MOV_A_IMM)
+		return 0;
+	if (ins->expr == NULL)
+		return ins->buf[1] == 0;
+	/* A label's address changes as the optimizer shrinks code. */
+	return expr_is_defined(ins->expr) && !expr_refers_to_label(ins->expr)
+		&& (eval_expr(ins->cur_file, ins->expr) & 0xFF) == 0;
+}
+
+/*
+ * Does a jump or branch go to a label that directly follows it in
+ * its section, with nothing but other markers in between?  Only
+ * then does it stay the next instruction when sections are placed
+ * again.
+ */
+static int jumps_to_next(struct Instruction *ins)
+{
+	struct Instruction *label = expr_label(ins->expr), *p;
+
+	if (label == NULL)
+		return 0;
+	for (p = ins->next; p != NULL && p->type == INS_LABEL; p = p->next) {
+		if (p == label)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * One pass of the optimizer over a section.
+ * Returns the number of changes made.
+ */
+static int optimize_section(struct Section *sect)
+{
+	struct Instruction *ins, *prev = NULL, *next, *clr;
+	int changes = 0, depth = 0, rb = -1, mb = -1, op, flow, target;
+
+	for (ins = sect->head; ins != NULL; ins = next) {
+		next = ins->next;
+		if (ins->type == INS_LABEL) {
+			/* A label may be reached from anywhere. */
+			depth = timed_depth(ins, depth);
+			rb = mb = -1;
+			prev = ins;
+			continue;
+		}
+		if (ins->type != INS_CODE || ins->size == 0 || depth > 0) {
+			rb = mb = -1;
+			prev = ins;
+			continue;
+		}
+
+		op = ins->buf[0];
+		flow = instruction_flow(ins, &target);
+
+		if (ins->size == 1 && (op == rb || op == mb)) {
+			saved(RULE_SEL, ins, NULL);
+			unlink_ins(sect, prev, ins);
+			changes++;
+			continue;
+		}
+		if ((flow == FLOW_JUMP || (flow == FLOW_BRANCH && op != OP_JTF && (op & 0xF8) != 0xE8))
+				&& target == ins->offset + ins->size && ins->loop_max < 0
+				&& jumps_to_next(ins)) {
+			/* Not jtf or djnz, which have side effects. */
+			saved(RULE_JUMP_NEXT, ins, NULL);
+			unlink_ins(sect, prev, ins);
+			changes++;
+			continue;
+		}
+		if (is_clear_a(ins)) {
+			clr = ins1(OP_CLR_A);
+			saved(RULE_CLR, ins, clr);
+			insert_before(ins, clr);
+			unlink_ins(sect, ins, ins->next);
+			next = ins->next;
+			changes++;
+		} else if (flow == FLOW_CALL && next != NULL && next->type == INS_CODE
+				&& next->size == 1 && next->buf[0] == OP_RET) {
+			/* The ret of the routine called returns to our caller. */
+			rules[RULE_TAIL_CALL].count++;
+			rules[RULE_TAIL_CALL].bytes++;
+			rules[RULE_TAIL_CALL].cycles += instruction_cycles(next->buf, next->size);
+			ins->buf[0] ^= 0x10;		/* CALL -> JMP */
+			unlink_ins(sect, ins, next);
+			next = ins->next;
+			changes++;
+		}
+
+		op = ins->buf[0];
+		if (ins->size == 1 && (op == OP_SEL_RB0 || op == OP_SEL_RB1))
+			rb = op;
+		else if (ins->size == 1 && (op == OP_SEL_MB0 || op == OP_SEL_MB1))
+			mb = op;
+		else if (ins->size == 1 && op == OP_MOV_PSW_A)
+			rb = -1;
+		else if (flow != FLOW_NEXT && flow != FLOW_BRANCH)
+			rb = mb = -1;
+		prev = ins;
+	}
+	return changes;
+}
+
+/*
+ * Optimize the laid out program, laying it out again after each
+ * pass, and print what each rule saved.
+ */
+void optimize(void)
+{
+	struct Section *sect;
+	int i, pass, changes;
+
+	for (pass = 0; pass < MAX_OPT_PASSES; pass++) {
+		changes = 0;
+		for (sect = sect_head; sect != NULL; sect = sect->next)
+			changes += optimize_section(sect);
+		if (changes == 0)
+			break;
+		place_sections();
+		layout();
+	}
+
+	printf("   Peephole optimizer:\n");
+	for (i = 0; i < NUM_RULES; i++) {
+		if (rules[i].count > 0)
+			printf("   %-26s %4d times, %4d bytes, %4d cycles saved\n",
+				rules[i].name, rules[i].count, rules[i].bytes, rules[i].cycles);
+	}
+}
@@ -0,0 +1,262 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Internal RAM allocation (.ram directive).  Each variable belongs
+ * to the routine its .ram directive is in (see routine.c), and a routine's
+ * variables are placed above those of every routine that may call
+ * it, so routines never live at the same time share addresses.
+ * Interrupt routines start above everything main code uses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asm48.h"
+
+/* First address free for variables: above register banks and stack. */
+#define RAM_START	0x20
+
+/* Size of internal RAM (-M). */
+int ram_size = 64;
+
+/* Declared variables, in source order. */
+struct RamVar *ram_vars;
+static struct RamVar *ram_vars_tail;
+
+/* Bytes of variables of each routine, and their first address (-1 if not placed). */
+static int *frame, *base;
+
+/*
+ * Declare a variable (.ram directive, or RAM record of an object).
+ */
+struct RamVar *add_ram_var(const char *name, int size, struct Instruction *mark, int line_num)
+{
+	struct RamVar *var = pool_alloc_buf(gen_pool, sizeof(struct RamVar));
+
+	if (size < 1 || size > 256 - RAM_START)
+		error_at(cur_file, line_num, 0, "RAM variable %s has invalid size %d", name, size);
+	var->name = dup_str(name);
+	var->size = size;
+	var->mark = mark;
+	var->addr = -1;
+	var->dead = 0;
+	var->cur_file = cur_file;
+	var->line_num = line_num;
+	var->next = NULL;
+	if (ram_vars_tail == NULL)
+		ram_vars = ram_vars_tail = var;
+	else {
+		ram_vars_tail->next = var;
+		ram_vars_tail = var;
+	}
+	return var;
+}
+
+/*
+ * Declare a variable at the current position (.ram directive).
+ */
+void ram_var(const char *name, int size, int line_num)
+{
+	add_ram_var(name, size, mark(), line_num);
+}
+
+/*
+ * Place the variables of routine r at addr or above, and those of
+ * the routines it calls above its own.  Returns a routine called
+ * recursively, or -1.
+ */
+static int place_routine(int r, int addr, int depth)
+{
+	int i, bad;
+
+	if (depth > num_routines)
+		return r;
+	if (base[r] >= addr)
+		return -1;
+	base[r] = addr;
+	for (i = 0; i < routines[r].num_callees; i++) {
+		bad = place_routine(routines[r].callees[i], addr + frame[r], depth + 1);
+		if (bad >= 0)
+			return bad;
+	}
+	return -1;
+}
+
+/*
+ * First address above the variables of all routines placed.
+ */
+static int ram_top(void)
+{
+	int i, top = RAM_START;
+
+	for (i = 0; i < num_routines; i++) {
+		if (base[i] >= 0 && base[i] + frame[i] > top)
+			top = base[i] + frame[i];
+	}
+	return top;
+}
+
+/*
+ * Name of the code at an address, for the RAM map.
+ */
+static const char *code_name(int addr)
+{
+	static char buf[16];
+	struct Symbol *sym;
+
+	for (sym = first_symbol(); sym != NULL; sym = sym->next) {
+		if (sym->type == SYMB_LABEL && (sym->ins != NULL ? sym->ins->offset : sym->value) == addr)
+			return sym->name;
+	}
+	if (addr == 0x000)
+		return "reset";
+	if (addr == 0x003)
+		return "external interrupt";
+	if (addr == 0x007)
+		return "timer interrupt";
+	sprintf(buf, "$%03X", addr);
+	return buf;
+}
+
+static int by_base(const void *a, const void *b)
+{
+	return base[*(const int *)a] - base[*(const int *)b];
+}
+
+/*
+ * Write the variables of each routine, ordered by address.
+ */
+static void write_ram_map(const char *filename, int top)
+{
+	FILE *fp = fopen(filename, "w");
+	struct RamVar *var;
+	int *order, i, n = 0, global = 0;
+
+	if (fp == NULL)
+		err_printf("Couldn't open %s for output\n", filename);
+	order = malloc((num_routines + 1) * sizeof(int));
+	if (order == NULL)
+		err_printf("Unable to allocate RAM tables\n");
+	for (i = 0; i < num_routines; i++) {
+		if (frame[i] > 0 && base[i] >= 0)
+			order[n++] = i;
+	}
+	qsort(order, n, sizeof(int), by_base);
+
+	fprintf(fp, "; *** asm48 v" VERSION " RAM map ***\n");
+	fprintf(fp, "; %d of %d bytes used, with the registers and stack\n", top, ram_size);
+	for (i = 0; i < n; i++) {
+		fprintf(fp, "\n%02X-%02X  %s\n", base[order[i]],
+			base[order[i]] + frame[order[i]] - 1, code_name(routines[order[i]].addr));
+		for (var = ram_vars; var != NULL; var = var->next) {
+			if (var->routine == order[i])
+				fprintf(fp, "  %02X  %-24s %3d\n", var->addr, var->name, var->size);
+		}
+	}
+	for (var = ram_vars; var != NULL; var = var->next) {
+		if (var->routine >= 0 || var->dead)
+			continue;
+		if (!global++)
+			fprintf(fp, "\nOutside routines\n");
+		fprintf(fp, "  %02X  %-24s %3d\n", var->addr, var->name, var->size);
+	}
+	free(order);
+	fclose(fp);
+}
+
+/*
+ * Give every variable an address and define it as a constant,
+ * then write the RAM map if map_file is not NULL.
+ */
+void allocate_ram(const char *map_file)
+{
+	struct RamVar *var;
+	int i, addr, top, bad;
+
+	if (ram_vars == NULL && map_file == NULL)
+		return;
+	find_routines();
+	frame = calloc(num_routines + 1, sizeof(int));
+	base = malloc((num_routines + 1) * sizeof(int));
+	if (frame == NULL || base == NULL)
+		err_printf("Unable to allocate RAM tables\n");
+	for (i = 0; i < num_routines; i++)
+		base[i] = -1;
+
+	/* Offsets of the variables within their routine. */
+	for (var = ram_vars; var != NULL; var = var->next) {
+		var->routine = -1;
+		if (var->dead)
+			continue;
+		addr = var->mark->offset;
+		var->routine = addr >= 0 && addr < MAX_ADDR ? owner_at[addr] : -1;
+		if (var->routine >= 0) {
+			var->addr = frame[var->routine];
+			frame[var->routine] += var->size;
+		}
+	}
+
+	/* Main code first, then the interrupts above it.  Interrupts don't nest. */
+	top = RAM_START;
+	for (i = 0; i < num_routines; i++) {
+		if (routines[i].kind == ROUTINE_CALLED)
+			continue;
+		bad = place_routine(i, top, 0);
+		if (bad >= 0)
+			error_at(NULL, 0, 0, "Routine %s is called recursively; its RAM variables can't be overlaid",
+				code_name(routines[bad].addr));
+		if (routines[i].kind == ROUTINE_RESET)
+			top = ram_top();
+	}
+
+	top = ram_top();
+	for (var = ram_vars; var != NULL; var = var->next) {
+		if (var->dead)
+			continue;
+		if (var->routine >= 0 && base[var->routine] >= 0) {
+			var->addr += base[var->routine];
+		} else {
+			var->routine = -1;
+			var->addr = top;
+			top += var->size;
+		}
+		if (var->addr + var->size > ram_size)
+			error_at(var->cur_file, var->line_num, 0, "RAM variable %s at %02X doesn't fit in %d bytes of RAM",
+				var->name, var->addr, ram_size);
+		if (lookup_symbol(var->name) != NULL)
+			error_at(var->cur_file, var->line_num, 0, "Redefinition of symbol %s", var->name);
+		else
+			define_symbol(var->name, var->addr, SYMB_CONST);
+	}
+
+	if (map_file != NULL)
+		write_ram_map(map_file, top);
+
+	free(frame);
+	free(base);
+}
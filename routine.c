@@ -0,0 +1,204 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Routines of the laid out program, shared by the passes that
+ * follow its control flow (bank tracking, RAM allocation, timing).
+ * Routines are found from the reset and interrupt vectors through
+ * calls.  An interrupt vector that the reset code or a routine it
+ * calls runs into is part of that code, not a routine of its own.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asm48.h"
+
+/* The reset, external interrupt and timer interrupt vectors. */
+const int routine_vectors[NUM_VECTORS] = { 0x000, 0x003, 0x007 };
+
+/* Code instruction at each address, NULL for none. */
+struct Instruction **code_at;
+
+/* Routines, in the order found: the reset routine is first. */
+struct Routine *routines;
+int num_routines;
+static int max_routines;
+
+/* Routine starting at each address, and routine owning it (-1 if none). */
+int *routine_at, *owner_at;
+
+/* Addresses seen by the routine walked last. */
+static int *seen;
+static int *work;
+
+/*
+ * Index the code by address.
+ */
+void index_code(void)
+{
+	struct Section *sect;
+	struct Instruction *ins;
+
+	if (code_at == NULL) {
+		code_at = malloc(MAX_ADDR * sizeof(struct Instruction *));
+		if (code_at == NULL)
+			err_printf("Unable to allocate code index\n");
+	}
+	memset(code_at, 0, MAX_ADDR * sizeof(struct Instruction *));
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		for (ins = sect->head; ins != NULL; ins = ins->next) {
+			if (ins->type == INS_CODE && ins->size > 0 && ins->offset >= 0 && ins->offset < MAX_ADDR)
+				code_at[ins->offset] = ins;
+		}
+	}
+}
+
+/*
+ * Find or add the routine at an address.
+ */
+static int add_routine(int addr, int kind)
+{
+	struct Routine *r;
+
+	if (routine_at[addr] >= 0)
+		return routine_at[addr];
+	if (num_routines == max_routines) {
+		max_routines = max_routines ? max_routines * 2 : 32;
+		routines = realloc(routines, max_routines * sizeof(struct Routine));
+		if (routines == NULL)
+			err_printf("Unable to allocate routine tables\n");
+	}
+	r = &routines[num_routines];
+	r->addr = addr;
+	r->kind = kind;
+	r->callees = NULL;
+	r->num_callees = 0;
+	routine_at[addr] = num_routines;
+	return num_routines++;
+}
+
+/*
+ * Note a call from routine r to the code at addr.
+ */
+static void add_callee(int r, int addr)
+{
+	int i, callee = add_routine(addr, ROUTINE_CALLED);
+
+	for (i = 0; i < routines[r].num_callees; i++) {
+		if (routines[r].callees[i] == callee)
+			return;
+	}
+	routines[r].callees = realloc(routines[r].callees, (routines[r].num_callees + 1) * sizeof(int));
+	if (routines[r].callees == NULL)
+		err_printf("Unable to allocate routine tables\n");
+	routines[r].callees[routines[r].num_callees++] = callee;
+}
+
+/*
+ * Follow the code of routine r up to its returns, noting the
+ * routines it calls.  An address reached by several routines
+ * belongs to the one starting closest before it.
+ */
+static void walk_routine(int r)
+{
+	struct Instruction *ins;
+	int num_work = 0, addr, target, targets[256], n, i, entry = routines[r].addr;
+
+	work[num_work++] = entry;
+	seen[entry] = r;
+	while (num_work > 0) {
+		addr = work[--num_work];
+		ins = code_at[addr];
+		if (owner_at[addr] < 0 || (entry <= addr && routines[owner_at[addr]].addr < entry))
+			owner_at[addr] = r;
+
+		n = 0;
+		switch (instruction_flow(ins, &target)) {
+			case FLOW_NEXT:
+				targets[n++] = addr + ins->size;
+				break;
+			case FLOW_JUMP:
+				targets[n++] = target;
+				break;
+			case FLOW_BRANCH:
+				targets[n++] = target;
+				targets[n++] = addr + ins->size;
+				break;
+			case FLOW_CALL:
+				if (target < MAX_ADDR && code_at[target] != NULL)
+					add_callee(r, target);
+				targets[n++] = addr + ins->size;
+				break;
+			case FLOW_INDIRECT:
+				n = jump_table_targets(ins, targets, 256);
+				if (n < 0)
+					n = 0;
+				break;
+		}
+		for (i = 0; i < n; i++) {
+			addr = targets[i];
+			if (addr >= 0 && addr < MAX_ADDR && code_at[addr] != NULL && seen[addr] != r) {
+				seen[addr] = r;
+				work[num_work++] = addr;
+			}
+		}
+	}
+}
+
+/*
+ * Index the code, and find the routines and who owns each address.
+ * Must be called again whenever the program has been laid out anew.
+ */
+void find_routines(void)
+{
+	int i, v, first;
+
+	index_code();
+	if (routine_at == NULL) {
+		routine_at = malloc(MAX_ADDR * sizeof(int));
+		owner_at = malloc(MAX_ADDR * sizeof(int));
+		seen = malloc(MAX_ADDR * sizeof(int));
+		work = malloc(MAX_ADDR * sizeof(int));
+		if (routine_at == NULL || owner_at == NULL || seen == NULL || work == NULL)
+			err_printf("Unable to allocate routine tables\n");
+	}
+	for (i = 0; i < MAX_ADDR; i++)
+		routine_at[i] = owner_at[i] = seen[i] = -1;
+	for (i = 0; i < num_routines; i++)
+		free(routines[i].callees);
+	num_routines = 0;
+
+	for (v = 0; v < NUM_VECTORS; v++) {
+		/* An interrupt vector the reset code runs into isn't a routine of its own. */
+		if (code_at[routine_vectors[v]] == NULL || owner_at[routine_vectors[v]] >= 0)
+			continue;
+		first = add_routine(routine_vectors[v], v == 0 ? ROUTINE_RESET : ROUTINE_IRQ);
+		for (i = first; i < num_routines; i++)
+			walk_routine(i);
+	}
+}
@@ -0,0 +1,746 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parse.tab.h"
+#include "asm48.h"
+
+/* List of sections, in order of creation. */
+struct Section *sect_head, *cur_section;
+static struct Section *sect_tail;
+
+/* File offset of each logical ROM bank, -1 until set by .bank. */
+int rom_bank_offset[MAX_ROM_BANKS] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+/* ROM bank new sections go into. */
+static int cur_rom_bank = 0;
+
+/* Size of the address space tracked when placing sections. */
+#define SPACE_SIZE (BANK_USAGE_MAX * 256)
+
+/* Placement passes before branch relaxation gives up. */
+#define MAX_RELAX_PASSES 64
+
+/* Conditional jumps that have an opposite, for branch relaxation. */
+static const struct {
+	unsigned char op, inverse;
+} inverse_jumps[] = {
+	{ 0xF6, 0xE6 }, { 0xE6, 0xF6 },		/* jc, jnc */
+	{ 0xC6, 0x96 }, { 0x96, 0xC6 },		/* jz, jnz */
+	{ 0x36, 0x26 }, { 0x26, 0x36 },		/* jt0, jnt0 */
+	{ 0x56, 0x46 }, { 0x46, 0x56 },		/* jt1, jnt1 */
+	{ 0, 0 },
+};
+
+/*
+ * Find the section with given name.
+ * Returns NULL if no such section exists.
+ */
+struct Section *find_section(const char *name)
+{
+	struct Section *sect;
+
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		if (strcmp(sect->name, name) == 0)
+			break;
+	}
+	return sect;
+}
+
+/*
+ * Create a new, empty section.
+ */
+struct Section *create_section(const char *name, int reloc)
+{
+	struct Section *sect = pool_alloc_buf(gen_pool, sizeof(struct Section));
+
+	sect->name = dup_str(name);
+	sect->reloc = reloc;
+	sect->rom_bank = cur_rom_bank;
+	sect->base = cur_rom_bank * MAX_ADDR;
+	sect->size = 0;
+	sect->end = 0;
+	sect->in_page = 0;
+	sect->page = -1;
+	sect->with = NULL;
+	sect->head = sect->tail = NULL;
+	sect->next = NULL;
+
+	if (sect_head == NULL)
+		sect_head = sect_tail = sect;
+	else {
+		sect_tail->next = sect;
+		sect_tail = sect;
+	}
+	return sect;
+}
+
+/*
+ * Make the named section current (.section directive),
+ * creating it as a relocatable section if necessary.
+ */
+void select_section(const char *name)
+{
+	struct Section *sect = find_section(name);
+
+	if (sect == NULL)
+		sect = create_section(name, 1);
+	else if (sect->rom_bank != cur_rom_bank)
+		error_at(cur_file, parse_src_line, 0, "Section %s is in ROM bank %d", name, sect->rom_bank);
+
+	cur_section->end = cur_offset;
+	cur_section = sect;
+	cur_offset = sect->end;
+}
+
+/*
+ * Switch to a logical ROM bank (.bank directive), with its own
+ * absolute section.  file_offset is where its address 0 goes in
+ * the output, or -1 for bank * 4K.
+ */
+void select_rom_bank(int bank, int file_offset, int line_num)
+{
+	char name[16];
+	struct Section *sect;
+
+	if (bank < 0 || bank >= MAX_ROM_BANKS) {
+		error_at(cur_file, line_num, 0, "ROM bank %d is out of range", bank);
+		return;
+	}
+	if (file_offset >= 0) {
+		if (rom_bank_offset[bank] >= 0 && rom_bank_offset[bank] != file_offset)
+			error_at(cur_file, line_num, 0, "ROM bank %d is already at file offset %d", bank, rom_bank_offset[bank]);
+		else
+			rom_bank_offset[bank] = file_offset;
+	}
+
+	cur_rom_bank = bank;
+	if (bank == 0)
+		strcpy(name, ABS_SECTION);
+	else
+		sprintf(name, "%s%d", ABS_SECTION, bank);
+	sect = find_section(name);
+	if (sect == NULL)
+		sect = create_section(name, 0);
+
+	cur_section->end = cur_offset;
+	cur_section = sect;
+	cur_offset = sect->end;
+}
+
+/*
+ * Offset in the output file of an offset in the image.
+ */
+int rom_file_offset(int offset)
+{
+	int bank = offset / MAX_ADDR;
+
+	if (bank < MAX_ROM_BANKS && rom_bank_offset[bank] >= 0)
+		return rom_bank_offset[bank] + ROM_ADDR(offset);
+	return offset;
+}
+
+/*
+ * Add a placement constraint to the current section:
+ * ".section NAME, inpage", ".section NAME, page N" or
+ * ".section NAME, with OTHER".
+ */
+void constrain_section(const char *kind, struct Expr *arg, int line_num)
+{
+	struct Section *sect = cur_section;
+	int page;
+
+	if (!sect->reloc) {
+		error_at(cur_file, line_num, 0, "Absolute section %s can't be constrained", sect->name);
+		return;
+	}
+	if (strcmp(kind, "inpage") == 0 && arg == NULL) {
+		sect->in_page = 1;
+	} else if (strcmp(kind, "page") == 0 && arg != NULL) {
+		page = eval_expr(cur_file, arg);
+		if (page < 0 || page >= MAX_ADDR / 256)
+			error_at(cur_file, line_num, 0, "Page %d is out of range", page);
+		else
+			sect->page = page;
+	} else if (strcmp(kind, "with") == 0 && arg != NULL && arg->op == IDENTIFIER && arg->mark == NULL) {
+		sect->with = arg->sym;
+	} else {
+		error_at(cur_file, line_num, 0, "Unknown section constraint '%s'", kind);
+	}
+}
+
+/*
+ * Mark the bytes occupied by a section.
+ * Filler of absolute sections is free space.
+ * Overlaps are only reported if report is nonzero.
+ */
+static void claim_section(unsigned char *used, struct Section *sect, int report)
+{
+	struct Instruction *ins;
+	int i, addr;
+
+	for (ins = sect->head; ins != NULL; ins = ins->next) {
+		if (ins->type == INS_FILL && !sect->reloc)
+			continue;
+		for (i = 0; i < ins->size; i++) {
+			addr = ins->offset + i;
+			if (addr >= SPACE_SIZE) {
+				if (report)
+					error_at(ins->cur_file, ins->src_line, 0, "Section %s extends beyond address %d",
+					sect->name, SPACE_SIZE);
+				return;
+			}
+			if (used[addr]) {
+				if (report)
+					error_at(ins->cur_file, ins->src_line, 0, "Section %s overlaps other code at address %04X",
+						sect->name, addr);
+				break;
+			}
+			used[addr] = 1;
+		}
+	}
+}
+
+/*
+ * Return nonzero if size bytes at addr are free, and don't
+ * run across a memory bank boundary (or a page boundary,
+ * if in_page is nonzero).
+ */
+static int fits(const unsigned char *used, int addr, int size, int in_page)
+{
+	int i;
+
+	if (addr / BANK_SIZE != (addr + size - 1) / BANK_SIZE)
+		return 0;
+	if (in_page && (addr & PAGE_MASK) != ((addr + size - 1) & PAGE_MASK))
+		return 0;
+	for (i = 0; i < size; i++) {
+		if (used[addr + i])
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Find the best place for size bytes between lo and hi: the start
+ * of the free gap that leaves the least space unused.  Returns -1
+ * if there is no room.
+ */
+static int best_fit(const unsigned char *used, int lo, int hi, int size, int in_page)
+{
+	int addr, end, limit, best = -1, best_left = SPACE_SIZE;
+
+	for (addr = lo; addr + size <= hi; addr++) {
+		if (addr > lo && !used[addr - 1] && addr % BANK_SIZE != 0 && !(in_page && (addr & 0xFF) == 0))
+			continue;		/* Not the start of a gap. */
+		if (!fits(used, addr, size, in_page))
+			continue;
+		limit = in_page ? (addr | 0xFF) + 1 : (addr / BANK_SIZE + 1) * BANK_SIZE;
+		if (limit > hi)
+			limit = hi;
+		for (end = addr + size; end < limit && !used[end]; end++)
+			;
+		if (end - addr - size < best_left) {
+			best = addr;
+			best_left = end - addr - size;
+		}
+	}
+	return best;
+}
+
+/*
+ * Does a section have to fit in one page?
+ */
+static int needs_page(struct Section *sect)
+{
+	struct Section *other;
+
+	if (sect->in_page || sect->page >= 0 || sect->with != NULL)
+		return 1;
+	for (other = sect_head; other != NULL; other = other->next) {
+		if (other->with != NULL && strcmp(other->with, sect->name) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * The section a section must share its page with, following
+ * chains of ".section X, with Y" to the first section of the
+ * group.  NULL if none (or the chain runs in a circle).
+ */
+static struct Section *partner(struct Section *sect)
+{
+	struct Section *other = sect;
+	int depth;
+
+	for (depth = 0; other->with != NULL; depth++) {
+		other = find_section(other->with);
+		if (other == NULL || !other->reloc || other == sect || depth > 64)
+			return NULL;
+	}
+	return other != sect ? other : NULL;
+}
+
+/*
+ * Total size of a section and the sections placed with it.
+ */
+static int group_size(struct Section *sect)
+{
+	struct Section *other;
+	int size = sect->size;
+
+	for (other = sect_head; other != NULL; other = other->next) {
+		if (partner(other) == sect)
+			size += other->size;
+	}
+	return size;
+}
+
+/*
+ * Placement order: sections in a given page first, then the
+ * largest groups, then source order.
+ */
+static int placement_order(const void *a, const void *b)
+{
+	struct Section *sa = *(struct Section * const *) a, *sb = *(struct Section * const *) b;
+	struct Section *sect;
+
+	if ((sa->page >= 0) != (sb->page >= 0))
+		return sa->page >= 0 ? -1 : 1;
+	if (group_size(sa) != group_size(sb))
+		return group_size(sb) - group_size(sa);
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		if (sect == sa)
+			return -1;
+		if (sect == sb)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Place a section and the sections that must share its page.
+ * Returns nonzero on success; on failure nothing is claimed.
+ */
+static int place_group(unsigned char *used, struct Section *sect)
+{
+	struct Section *other, *failed;
+	int in_page = needs_page(sect);
+	int lo = sect->rom_bank * MAX_ADDR, hi = lo + MAX_ADDR, addr, page;
+
+	if (sect->page >= 0) {
+		lo += sect->page * 256;
+		hi = lo + 256;
+	}
+	if (!in_page || group_size(sect) == sect->size) {
+		addr = best_fit(used, lo, hi, sect->size, in_page);
+		if (addr < 0)
+			return 0;
+		sect->base = addr;
+		memset(used + addr, 1, sect->size);
+		return 1;
+	}
+
+	/* Try each page in turn for the whole group. */
+	for (page = lo; page < hi; page += 256) {
+		addr = best_fit(used, page, page + 256, sect->size, 1);
+		if (addr < 0)
+			continue;
+		sect->base = addr;
+		memset(used + addr, 1, sect->size);
+		for (failed = sect_head; failed != NULL; failed = failed->next) {
+			if (partner(failed) != sect || failed->size == 0)
+				continue;
+			addr = best_fit(used, page, page + 256, failed->size, 1);
+			if (addr < 0)
+				break;
+			failed->base = addr;
+			memset(used + addr, 1, failed->size);
+		}
+		if (failed == NULL)
+			return 1;
+
+		/* Give back what was claimed in this page. */
+		memset(used + sect->base, 0, sect->size);
+		for (other = sect_head; other != failed; other = other->next) {
+			if (partner(other) == sect && other->size > 0)
+				memset(used + other->base, 0, other->size);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Assign a base address to each relocatable section and lay out
+ * the program.  Problems are only reported if report is nonzero.
+ */
+static void assign_bases(int report)
+{
+	unsigned char *used = calloc(SPACE_SIZE, 1);
+	struct Section **order, *sect;
+	int i, n = 0;
+
+	for (sect = sect_head; sect != NULL; sect = sect->next)
+		n++;
+	order = malloc(n * sizeof(struct Section *));
+	if (used == NULL || order == NULL)
+		err_printf("Unable to allocate placement map\n");
+
+	layout();
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		if (!sect->reloc)
+			claim_section(used, sect, report);
+	}
+
+	n = 0;
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		if (!sect->reloc || sect->size == 0)
+			continue;
+		if (sect->with != NULL && partner(sect) == NULL) {
+			if (report)
+				error_at(NULL, 0, 0, "Section %s is placed with unknown section %s", sect->name, sect->with);
+			continue;
+		}
+		if (partner(sect) == NULL)
+			order[n++] = sect;
+	}
+	qsort(order, n, sizeof(struct Section *), placement_order);
+
+	for (i = 0; i < n; i++) {
+		sect = order[i];
+		if (sect->size > BANK_SIZE || (needs_page(sect) && group_size(sect) > 256)) {
+			if (report)
+				error_at(NULL, 0, 0, "Section %s (%d bytes) is larger than a %s", sect->name,
+					group_size(sect), needs_page(sect) ? "page" : "memory bank");
+			continue;
+		}
+		if (!place_group(used, sect) && report)
+			error_at(NULL, 0, 0, "No room for section %s (%d bytes)", sect->name, group_size(sect));
+	}
+	layout();
+
+	free(order);
+	free(used);
+}
+
+/*
+ * Insert an instruction made by branch relaxation after pos,
+ * attributing it to the same source line.
+ */
+static void insert_after(struct Instruction *pos, struct Instruction *ins)
+{
+	ins->section = pos->section;
+	ins->cur_file = pos->cur_file;
+	ins->src_line = pos->src_line;
+	ins->next = pos->next;
+	pos->next = ins;
+	if (pos->section->tail == pos)
+		pos->section->tail = ins;
+}
+
+/*
+ * Rewrite a conditional jump whose target is out of its page
+ * into a short jump around a jmp to the target:
+ *
+ *	jz far		->	jnz skip
+ *				jmp far
+ *			skip:
+ *
+ * Jumps without an opposite (djnz, jb, jf0, ...) go to a jmp instead:
+ *
+ *	djnz r7, far	->	djnz r7, taken
+ *				jmp next
+ *			taken:	jmp far
+ *			next:
+ *
+ * Returns the number of bytes added.
+ */
+static int relax_jump(struct Instruction *ins)
+{
+	struct Instruction *far = jmp_ins(0x04, ins->expr);
+	struct Instruction *skip, *taken;
+	int i;
+
+	far->loop_min = ins->loop_min;
+	far->loop_max = ins->loop_max;
+	ins->loop_max = -1;
+	ins->value = 1;
+
+	for (i = 0; inverse_jumps[i].op != 0; i++) {
+		if (inverse_jumps[i].op == ins->buf[0])
+			break;
+	}
+	if (inverse_jumps[i].op != 0) {
+		skip = new_mark();
+		ins->buf[0] = inverse_jumps[i].inverse;
+		ins->expr = mk_mark_expr(skip, ins->src_line);
+		insert_after(ins, far);
+		insert_after(far, skip);
+		return 2;
+	}
+
+	taken = new_mark();
+	skip = new_mark();
+	ins->expr = mk_mark_expr(taken, ins->src_line);
+	insert_after(ins, jmp_ins(0x04, mk_mark_expr(skip, ins->src_line)));
+	insert_after(ins->next, taken);
+	insert_after(taken, far);
+	insert_after(far, skip);
+	return 4;
+}
+
+/*
+ * One pass of branch relaxation over the laid out program.
+ * A jump made by an earlier rewrite that has itself crossed a
+ * page boundary is pushed into the next page with nops instead.
+ * Returns the number of bytes added.
+ */
+static int relax_pass(void)
+{
+	struct Section *sect;
+	struct Instruction *ins, *prev, *nop;
+	const char *kind;
+	int address, added = 0, n;
+
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		prev = NULL;
+		for (ins = sect->head; ins != NULL; prev = ins, ins = ins->next) {
+			kind = fixup_kind(ins);
+			if (ins->type != INS_CODE || ins->size != 2 || kind == NULL || strcmp(kind, "j8") != 0
+					|| !expr_is_defined(ins->expr))
+				continue;
+			address = eval_expr(ins->cur_file, ins->expr);
+			if ((address & PAGE_MASK) == (ROM_ADDR(ins->offset + 1) & PAGE_MASK))
+				continue;
+			if (!ins->value) {
+				n = relax_jump(ins);
+				printf("   [%s] Line %d: jump to %04X out of page, %d bytes added\n",
+					ins->cur_file, ins->src_line, address, n);
+			} else {
+				nop = ins1(0x00);
+				nop->section = sect;
+				nop->cur_file = ins->cur_file;
+				nop->src_line = ins->src_line;
+				nop->next = ins;
+				if (prev == NULL)
+					sect->head = nop;
+				else
+					prev->next = nop;
+				n = 1;
+			}
+			added += n;
+		}
+	}
+	return added;
+}
+
+/*
+ * Assign a base address to each relocatable section.
+ * Absolute sections stay where .org put them; relocatable
+ * sections go into the first free gap, in source order.
+ * With -r, conditional jumps that end up out of page are
+ * rewritten and the program placed again until it is stable.
+ */
+void place_sections(void)
+{
+	int pass, added, total = 0;
+
+	if (relax_branches) {
+		for (pass = 0; pass < MAX_RELAX_PASSES; pass++) {
+			assign_bases(0);
+			added = relax_pass();
+			if (added == 0)
+				break;
+			total += added;
+		}
+		if (total > 0)
+			printf("   Branch relaxation added %d bytes.\n", total);
+	}
+	assign_bases(1);
+}
+
+/*
+ * Assign offsets to all instructions, starting each section
+ * at its base address.  Filler is resized to reach its .org
+ * target and labels take the offset of their markers.
+ */
+void layout(void)
+{
+	struct Section *sect;
+	struct Instruction *ins;
+	int offset;
+
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		offset = sect->base;
+		for (ins = sect->head; ins != NULL; ins = ins->next) {
+			ins->offset = offset;
+			if (ins->type == INS_FILL) {
+				ins->size = sect->base + ins->value - offset;
+				if (ins->size < 0) {
+					error_at(ins->cur_file, ins->src_line, 0, "org directive of address %d less than current address %d",
+						ins->value, offset - sect->base);
+					ins->value = offset - sect->base;
+					ins->size = 0;
+				}
+			} else if (ins->type == INS_LABEL && ins->sym != NULL) {
+				ins->sym->value = ROM_ADDR(offset);
+			}
+			offset += ins->size;
+		}
+		sect->size = offset - sect->base;
+	}
+	update_equates();
+}
+
+/*
+ * Build the output image from all sections.
+ * Filler is written first, so code placed into the
+ * gaps of an absolute section replaces it.
+ */
+unsigned char *build_image(int *size)
+{
+	struct Section *sect;
+	struct Instruction *ins;
+	unsigned char *image;
+	int end = 0, pass;
+
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		for (ins = sect->head; ins != NULL; ins = ins->next) {
+			if (ins->size > 0 && rom_file_offset(ins->offset) + ins->size > end)
+				end = rom_file_offset(ins->offset) + ins->size;
+		}
+	}
+
+	image = calloc(end + 1, 1);
+	if (image == NULL)
+		err_printf("Unable to allocate %d bytes for output image\n", end);
+
+	for (pass = 0; pass < 2; pass++) {
+		for (sect = sect_head; sect != NULL; sect = sect->next) {
+			for (ins = sect->head; ins != NULL; ins = ins->next) {
+				if (ins->size == 0 || (ins->type == INS_FILL) != (pass == 0))
+					continue;
+				if (ins->type == INS_FILL)
+					memset(image + rom_file_offset(ins->offset), ins->buf[0], ins->size);
+				else
+					memcpy(image + rom_file_offset(ins->offset), ins->buf, ins->size);
+			}
+		}
+	}
+
+	*size = end;
+	return image;
+}
+
+/*
+ * Count the bytes used in each 256-byte page.
+ * Filler isn't counted.
+ */
+void compute_bank_usage(void)
+{
+	struct Section *sect;
+	struct Instruction *ins;
+	int i, addr;
+
+	memset(bank_usage, 0, sizeof(bank_usage));
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		for (ins = sect->head; ins != NULL; ins = ins->next) {
+			if (ins->type == INS_FILL)
+				continue;
+			for (i = 0; i < ins->size; i++) {
+				addr = ins->offset + i;
+				if (addr < SPACE_SIZE)
+					bank_usage[addr >> 8]++;
+			}
+		}
+	}
+}
+
+/*
+ * Print the free gaps of each ROM bank the program uses, up to the
+ * end of its code rounded up to a ROM size (-t option).  Filler is
+ * free space.  With several banks, the gaps are given like the bank
+ * usage table: by bank, address within the bank and file offset.
+ */
+void report_free_space(void)
+{
+	unsigned char *used = calloc(SPACE_SIZE, 1);
+	struct Section *sect;
+	struct Instruction *ins;
+	int end[MAX_ROM_BANKS], bank, base, rom, banked = 0, addr, start, i, total = 0, gaps = 0;
+
+	if (used == NULL)
+		err_printf("Unable to allocate placement map\n");
+	memset(end, 0, sizeof(end));
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		for (ins = sect->head; ins != NULL; ins = ins->next) {
+			if (ins->type == INS_FILL)
+				continue;
+			for (i = 0; i < ins->size && ins->offset + i < SPACE_SIZE; i++) {
+				addr = ins->offset + i;
+				used[addr] = 1;
+				if (ROM_ADDR(addr) >= end[addr / MAX_ADDR])
+					end[addr / MAX_ADDR] = ROM_ADDR(addr) + 1;
+			}
+		}
+	}
+	for (bank = 1; bank < MAX_ROM_BANKS; bank++) {
+		if (end[bank] > 0)
+			banked = 1;
+	}
+
+	printf("\n   Free space:\n");
+	for (bank = 0; bank < MAX_ROM_BANKS; bank++) {
+		if (bank > 0 && end[bank] == 0)
+			continue;
+		for (rom = 1024; rom < end[bank] && rom < MAX_ADDR; rom *= 2)
+			;
+		base = bank * MAX_ADDR;
+		for (addr = 0; addr < rom; ) {
+			if (used[base + addr]) {
+				addr++;
+				continue;
+			}
+			for (start = addr++; addr < rom && !used[base + addr]; addr++)
+				;
+			if (banked)
+				printf(" ROM bank %d %03X-%03X at file offset %05X, %4d bytes\n", bank, start, addr - 1,
+					rom_file_offset(base + start), addr - start);
+			else
+				printf(" %04X-%04X, %4d bytes\n", start, addr - 1, addr - start);
+			total += addr - start;
+			gaps++;
+		}
+	}
+	printf(" %d bytes free in %d gaps\n", total, gaps);
+	free(used);
+}
@@ -0,0 +1,765 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Runs a ROM image built by asm48, counting machine cycles
+ * exactly, and reports where the time went.  Instructions are
+ * decoded with the opcode table of the 8039dasm disassembler.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_GETOPT
+#include <unistd.h>
+#endif
+
+#include "8039dasm.h"
+
+#ifndef HAVE_GETOPT
+extern int opterr, optind, optopt, optreset;
+extern char *optarg;
+int getopt(int nargc, char * const *nargv, const char *ostr);
+#endif
+
+#define ROM_SIZE 4096		/* Program memory addressable by the PC. */
+#define DEFAULT_CYCLES 10000000	/* Default cycle limit. */
+#define DEFAULT_HOT 20		/* Hot spots shown by default. */
+#define TIMER_PRESCALE 32	/* Machine cycles per timer increment. */
+
+/* PSW bits. */
+#define PSW_CY 0x80
+#define PSW_AC 0x40
+#define PSW_F0 0x20
+#define PSW_BS 0x10
+#define PSW_SP 0x07
+
+/* Next program counter: the PC wraps within its 2K bank. */
+#define NEXT_PC(p) (((p) & 0x800) | (((p) + 1) & 0x7FF))
+
+/*
+ * Instruction kinds, one per entry of the disassembler's opcode
+ * table.  Register, port and bit numbers come from the opcode.
+ */
+enum {
+	K_ILLEGAL,
+	K_ADD_I, K_ADD_R, K_ADD_M, K_ADDC_I, K_ADDC_R, K_ADDC_M,
+	K_ANL_I, K_ANL_R, K_ANL_M, K_ANL_BUS, K_ANL_P1, K_ANL_P2, K_ANLD,
+	K_CALL, K_CLR_A, K_CLR_C, K_CLR_F1, K_CLR_F0,
+	K_CPL_A, K_CPL_C, K_CPL_F0, K_CPL_F1, K_DA, K_DEC_A, K_DEC_R,
+	K_DIS_I, K_DIS_TCNTI, K_DJNZ, K_EN_I, K_EN_TCNTI, K_ENT0,
+	K_IN_P1, K_IN_P2, K_INC_A, K_INC_R, K_INC_M, K_INS,
+	K_JTF, K_JNT0, K_JT0, K_JNT1, K_JT1, K_JF1, K_JNI, K_JNZ, K_JF0,
+	K_JZ, K_JNC, K_JC, K_JB, K_JMP, K_JMPP,
+	K_MOV_A_I, K_MOV_A_R, K_MOV_A_M, K_MOV_A_PSW, K_MOV_R_I, K_MOV_R_A,
+	K_MOV_M_A, K_MOV_M_I, K_MOV_PSW_A, K_MOVD_A_P, K_MOVD_P_A,
+	K_MOV_A_T, K_MOV_T_A, K_MOVP3, K_MOVP, K_MOVX_A_M, K_MOVX_M_A,
+	K_ORL_R, K_ORL_M, K_ORL_I, K_ORL_BUS, K_ORL_P1, K_ORL_P2, K_ORLD,
+	K_OUTL_BUS, K_OUTL_P1, K_OUTL_P2, K_RET, K_RETR,
+	K_RL, K_RLC, K_RR, K_RRC, K_SEL_MB0, K_SEL_MB1, K_SEL_RB0, K_SEL_RB1,
+	K_STOP, K_STRT_CNT, K_STRT_T, K_SWAP, K_XCH_R, K_XCH_M, K_XCHD,
+	K_XRL_I, K_XRL_R, K_XRL_M, K_NOP
+};
+
+/*
+ * Map from disassembler format strings to instruction kinds.
+ */
+static const struct {
+	const char *fmt;
+	int kind;
+} kind_map[] = {
+	{ "add  a,#$%X", K_ADD_I }, { "add  a,%R", K_ADD_R }, { "add  a,@%R", K_ADD_M },
+	{ "addc a,#$%X", K_ADDC_I }, { "addc a,%R", K_ADDC_R }, { "addc a,@%R", K_ADDC_M },
+	{ "anl  a,#$%X", K_ANL_I }, { "anl  a,%R", K_ANL_R }, { "anl  a,@%R", K_ANL_M },
+	{ "anl  bus,#$%X", K_ANL_BUS }, { "anl  p1,#$%X", K_ANL_P1 }, { "anl  p2,#$%X", K_ANL_P2 },
+	{ "anld %P,a", K_ANLD }, { "call %A", K_CALL },
+	{ "clr  a", K_CLR_A }, { "clr  c", K_CLR_C }, { "clr  f1", K_CLR_F1 }, { "clr  f0", K_CLR_F0 },
+	{ "cpl  a", K_CPL_A }, { "cpl  c", K_CPL_C }, { "cpl  f0", K_CPL_F0 }, { "cpl  f1", K_CPL_F1 },
+	{ "da   a", K_DA }, { "dec  a", K_DEC_A }, { "dec  %R", K_DEC_R },
+	{ "dis  i", K_DIS_I }, { "dis  tcnti", K_DIS_TCNTI }, { "djnz %R,%J", K_DJNZ },
+	{ "en   i", K_EN_I }, { "en   tcnti", K_EN_TCNTI }, { "ent0 clk", K_ENT0 },
+	{ "in   a,p1", K_IN_P1 }, { "in   a,p2", K_IN_P2 },
+	{ "inc  a", K_INC_A }, { "inc  %R", K_INC_R }, { "inc  @%R", K_INC_M }, { "ins  a,bus", K_INS },
+	{ "jtf  %J", K_JTF }, { "jnt0 %J", K_JNT0 }, { "jt0  %J", K_JT0 }, { "jnt1 %J", K_JNT1 },
+	{ "jt1  %J", K_JT1 }, { "jf1  %J", K_JF1 }, { "jni  %J", K_JNI }, { "jnz  %J", K_JNZ },
+	{ "jf0  %J", K_JF0 }, { "jz   %J", K_JZ }, { "jnc  %J", K_JNC }, { "jc   %J", K_JC },
+	{ "jb%B  %J", K_JB }, { "jmp  %A", K_JMP }, { "jmpp @a", K_JMPP },
+	{ "mov  a,#$%X", K_MOV_A_I }, { "mov  a,%R", K_MOV_A_R }, { "mov  a,@%R", K_MOV_A_M },
+	{ "mov  a,psw", K_MOV_A_PSW }, { "mov  %R,#$%X", K_MOV_R_I }, { "mov  %R,a", K_MOV_R_A },
+	{ "mov  @%R,a", K_MOV_M_A }, { "mov  @%R,#$%X", K_MOV_M_I }, { "mov  psw,a", K_MOV_PSW_A },
+	{ "movd a,%P", K_MOVD_A_P }, { "movd %P,a", K_MOVD_P_A },
+	{ "mov  a,t", K_MOV_A_T }, { "mov  t,a", K_MOV_T_A },
+	{ "movp3 a,@a", K_MOVP3 }, { "movp a,@a", K_MOVP },
+	{ "movx a,@%R", K_MOVX_A_M }, { "movx @%R,a", K_MOVX_M_A },
+	{ "orl  a,%R", K_ORL_R }, { "orl  a,@%R", K_ORL_M }, { "orl  a,#$%X", K_ORL_I },
+	{ "orl  bus,#$%X", K_ORL_BUS }, { "orl  p1,#$%X", K_ORL_P1 }, { "orl  p2,#$%X", K_ORL_P2 },
+	{ "orld %P,a", K_ORLD }, { "outl bus,a", K_OUTL_BUS }, { "outl p1,a", K_OUTL_P1 },
+	{ "outl p2,a", K_OUTL_P2 }, { "ret", K_RET }, { "retr", K_RETR },
+	{ "rl   a", K_RL }, { "rlc  a", K_RLC }, { "rr   a", K_RR }, { "rrc  a", K_RRC },
+	{ "sel  mb0", K_SEL_MB0 }, { "sel  mb1", K_SEL_MB1 }, { "sel  rb0", K_SEL_RB0 },
+	{ "sel  rb1", K_SEL_RB1 }, { "stop tcnt", K_STOP }, { "strt cnt", K_STRT_CNT },
+	{ "strt t", K_STRT_T }, { "swap a", K_SWAP },
+	{ "xch  a,%R", K_XCH_R }, { "xch  a,@%R", K_XCH_M }, { "xchd a,@%R", K_XCHD },
+	{ "xrl  a,#$%X", K_XRL_I }, { "xrl  a,%R", K_XRL_R }, { "xrl  a,@%R", K_XRL_M },
+	{ "nop", K_NOP },
+	{ NULL, 0 }
+};
+
+/*
+ * Predecoded opcode: what to do, how long it is, how long it takes.
+ */
+struct Decoded {
+	unsigned char kind;
+	unsigned char len;
+	unsigned char cycles;
+};
+
+static struct Decoded decoded[256];
+
+/*
+ * A label read from a symbols file.
+ */
+struct Label {
+	char *name;
+	int addr;
+};
+
+static struct Label *labels;
+static int num_labels;
+
+/* Memory. */
+static unsigned char rom[ROM_SIZE];
+static unsigned char ram[256];
+static unsigned char xram[256];
+static int ram_mask = 63;
+
+/* Processor state. */
+static int acc, pc, psw, timer, f1, mb, in_irq;
+static int timer_mode;		/* 0 = stopped, 1 = timer, 2 = event counter */
+static int prescaler, timer_flag, timer_irq, tcnti_enabled, int_enabled;
+static int int_pin = 1, t0_pin = 1, t1_pin = 1;
+static unsigned char port_out[3] = { 0xFF, 0xFF, 0xFF };	/* BUS, P1, P2 */
+static unsigned char port_in[3] = { 0xFF, 0xFF, 0xFF };
+static unsigned char exp_port[8];				/* 8243 P4-P7 */
+
+/* Statistics. */
+static unsigned long long total_cycles, total_ins;
+static unsigned long hits[ROM_SIZE];
+static unsigned long long cycles[ROM_SIZE];
+
+/*
+ * Print command line usage information.
+ */
+static void usage(void)
+{
+	const char *msg =
+		"Usage: sim48 [options] <image file>\n"
+		"Options:\n"
+		"  -s <filename>    Read labels from a symbols file written by asm48 -s or -S\n"
+		"  -n <cycles>      Stop after this many machine cycles (default 10000000)\n"
+		"  -b <address>     Stop when execution reaches an address or label\n"
+		"  -r <bytes>       Size of internal RAM: 64, 128 or 256 (default 64)\n"
+		"  -p <count>       Print a profile: this many hot spots, then time per label\n"
+		"  -t               Trace every instruction\n";
+
+	fprintf(stderr, "%s", msg);
+}
+
+/*
+ * Build the predecoded opcode table from the disassembler's
+ * opcode table.
+ */
+static void init_decoder(void)
+{
+	int code, op, i;
+	const char *fmt;
+
+	for (code = 0; code < 256; code++) {
+		decoded[code].kind = K_ILLEGAL;
+		decoded[code].len = 1;
+		decoded[code].cycles = 1;
+
+		op = Match8039(code);
+		if (op < 0)
+			continue;
+		fmt = Format8039(op);
+		for (i = 0; kind_map[i].fmt != NULL; i++) {
+			if (strcmp(kind_map[i].fmt, fmt) == 0)
+				break;
+		}
+		if (kind_map[i].fmt == NULL) {
+			fprintf(stderr, "No simulation for opcode %02X (%s)\n", code, fmt);
+			exit(1);
+		}
+		decoded[code].kind = kind_map[i].kind;
+		decoded[code].len = Length8039(op);
+		decoded[code].cycles = Cycles8039(op);
+	}
+}
+
+/*
+ * Order labels by address.
+ */
+static int cmp_label(const void *a, const void *b)
+{
+	const struct Label *la = a, *lb = b;
+	return la->addr != lb->addr ? la->addr - lb->addr : strcmp(la->name, lb->name);
+}
+
+/*
+ * Remember a label.
+ */
+static void add_label(const char *name, int addr)
+{
+	labels = realloc(labels, (num_labels + 1) * sizeof(struct Label));
+	if (labels == NULL) {
+		fprintf(stderr, "Out of memory reading labels\n");
+		exit(1);
+	}
+	labels[num_labels].name = strdup(name);
+	labels[num_labels].addr = addr;
+	num_labels++;
+}
+
+/*
+ * Remember a label of a symbols file; constants are ignored.
+ */
+static void add_symbol(const char *name, unsigned long value, int is_label)
+{
+	if (is_label)
+		add_label(name, value & (ROM_SIZE - 1));
+}
+
+/*
+ * Find the label at or before an address, or NULL.
+ */
+static struct Label *find_label(int addr)
+{
+	int lo = 0, hi = num_labels - 1, mid;
+	struct Label *best = NULL;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (labels[mid].addr <= addr) {
+			best = &labels[mid];
+			lo = mid + 1;
+		} else
+			hi = mid - 1;
+	}
+	return best;
+}
+
+/*
+ * Format an address as label+offset.
+ */
+static const char *addr_name(int addr)
+{
+	static char buf[300];
+	struct Label *label = find_label(addr);
+
+	if (label == NULL)
+		sprintf(buf, "$%03X", addr);
+	else if (label->addr == addr)
+		sprintf(buf, "%s", label->name);
+	else
+		sprintf(buf, "%s+%d", label->name, addr - label->addr);
+	return buf;
+}
+
+/*
+ * Parse an address given as a label or a number.
+ */
+static int parse_addr(const char *str)
+{
+	char *end;
+	long value;
+	int i;
+
+	for (i = 0; i < num_labels; i++) {
+		if (strcmp(labels[i].name, str) == 0)
+			return labels[i].addr;
+	}
+	value = strtol(str, &end, 0);
+	if (*end != '\0' || value < 0 || value >= ROM_SIZE) {
+		fprintf(stderr, "Unknown address \"%s\"\n", str);
+		exit(1);
+	}
+	return value;
+}
+
+/*
+ * Stack: each level takes two bytes of RAM starting at 8, the
+ * return address and the upper half of the PSW.
+ */
+static void push_pc(int ret)
+{
+	int sp = psw & PSW_SP;
+
+	ram[8 + 2 * sp] = ret;
+	ram[9 + 2 * sp] = ((ret >> 8) & 0x0F) | (psw & 0xF0);
+	psw = (psw & ~PSW_SP) | ((sp + 1) & PSW_SP);
+}
+
+static int pop_pc(int restore_psw)
+{
+	int sp = (psw - 1) & PSW_SP;
+	int hi = ram[9 + 2 * sp];
+
+	psw = (psw & ~PSW_SP) | sp;
+	if (restore_psw)
+		psw = (psw & 0x0F) | (hi & 0xF0);
+	return ram[8 + 2 * sp] | ((hi & 0x0F) << 8);
+}
+
+/*
+ * Add to the accumulator, setting carry and auxiliary carry.
+ */
+static void add_acc(int value, int carry)
+{
+	int res = acc + value + carry;
+
+	psw &= ~(PSW_CY | PSW_AC);
+	if (res > 0xFF)
+		psw |= PSW_CY;
+	if ((acc & 0x0F) + (value & 0x0F) + carry > 0x0F)
+		psw |= PSW_AC;
+	acc = res & 0xFF;
+}
+
+/*
+ * Advance the timer by a number of machine cycles.
+ */
+static void run_timer(int n)
+{
+	prescaler += n;
+	while (prescaler >= TIMER_PRESCALE) {
+		prescaler -= TIMER_PRESCALE;
+		timer = (timer + 1) & 0xFF;
+		if (timer == 0) {
+			timer_flag = 1;
+			if (tcnti_enabled)
+				timer_irq = 1;
+		}
+	}
+}
+
+/*
+ * Take a pending interrupt, if any.  Returns the cycles it took.
+ */
+static int check_interrupts(void)
+{
+	int vector;
+
+	if (in_irq)
+		return 0;
+	if (int_enabled && !int_pin)
+		vector = 3;
+	else if (timer_irq) {
+		timer_irq = 0;
+		vector = 7;
+	} else
+		return 0;
+
+	push_pc(pc);
+	pc = vector;
+	in_irq = 1;
+	return 2;
+}
+
+/* Register and indirect RAM operands. */
+#define REG(r) ram[((psw & PSW_BS) ? 24 : 0) + (r)]
+#define IND(r) ram[REG(r) & ram_mask]
+
+/* Conditional jump within the page of the operand byte. */
+#define JUMP_IF(cond) if (cond) pc = ((addr + 1) & 0xF00) | arg
+
+/*
+ * Execute one instruction.  Returns 0 if the simulation should
+ * stop (illegal opcode or a halt loop).
+ */
+static int step(void)
+{
+	int addr = pc, code = rom[pc], arg = 0, n, t;
+	const struct Decoded *d = &decoded[code];
+
+	pc = NEXT_PC(pc);
+	if (d->len == 2) {
+		arg = rom[pc];
+		pc = NEXT_PC(pc);
+	}
+
+	switch (d->kind) {
+	case K_ILLEGAL:
+		fprintf(stderr, "Illegal opcode %02X at %s\n", code, addr_name(addr));
+		return 0;
+
+	case K_ADD_I: add_acc(arg, 0); break;
+	case K_ADD_R: add_acc(REG(code & 7), 0); break;
+	case K_ADD_M: add_acc(IND(code & 1), 0); break;
+	case K_ADDC_I: add_acc(arg, (psw & PSW_CY) != 0); break;
+	case K_ADDC_R: add_acc(REG(code & 7), (psw & PSW_CY) != 0); break;
+	case K_ADDC_M: add_acc(IND(code & 1), (psw & PSW_CY) != 0); break;
+
+	case K_ANL_I: acc &= arg; break;
+	case K_ANL_R: acc &= REG(code & 7); break;
+	case K_ANL_M: acc &= IND(code & 1); break;
+	case K_ANL_BUS: port_out[0] &= arg; break;
+	case K_ANL_P1: port_out[1] &= arg; break;
+	case K_ANL_P2: port_out[2] &= arg; break;
+	case K_ANLD: exp_port[4 + (code & 3)] &= acc & 0x0F; break;
+
+	case K_CALL:
+		push_pc(pc);
+		pc = (in_irq ? 0 : mb) | ((code & 0xE0) << 3) | arg;
+		break;
+
+	case K_CLR_A: acc = 0; break;
+	case K_CLR_C: psw &= ~PSW_CY; break;
+	case K_CLR_F1: f1 = 0; break;
+	case K_CLR_F0: psw &= ~PSW_F0; break;
+	case K_CPL_A: acc ^= 0xFF; break;
+	case K_CPL_C: psw ^= PSW_CY; break;
+	case K_CPL_F0: psw ^= PSW_F0; break;
+	case K_CPL_F1: f1 ^= 1; break;
+
+	case K_DA:
+		if ((acc & 0x0F) > 9 || (psw & PSW_AC)) {
+			acc += 6;
+			if (acc > 0xFF)
+				psw |= PSW_CY;
+			acc &= 0xFF;
+		}
+		if ((acc & 0xF0) > 0x90 || (psw & PSW_CY)) {
+			acc = (acc + 0x60) & 0xFF;
+			psw |= PSW_CY;
+		} else
+			psw &= ~PSW_CY;
+		break;
+
+	case K_DEC_A: acc = (acc - 1) & 0xFF; break;
+	case K_DEC_R: REG(code & 7)--; break;
+	case K_DIS_I: int_enabled = 0; break;
+	case K_DIS_TCNTI: tcnti_enabled = 0; timer_irq = 0; break;
+	case K_DJNZ: JUMP_IF(--REG(code & 7) != 0); break;
+	case K_EN_I: int_enabled = 1; break;
+	case K_EN_TCNTI: tcnti_enabled = 1; break;
+	case K_ENT0: break;
+
+	case K_IN_P1: acc = port_out[1] & port_in[1]; break;
+	case K_IN_P2: acc = port_out[2] & port_in[2]; break;
+	case K_INC_A: acc = (acc + 1) & 0xFF; break;
+	case K_INC_R: REG(code & 7)++; break;
+	case K_INC_M: IND(code & 1)++; break;
+	case K_INS: acc = port_in[0]; break;
+
+	case K_JTF: JUMP_IF(timer_flag); timer_flag = 0; break;
+	case K_JNT0: JUMP_IF(!t0_pin); break;
+	case K_JT0: JUMP_IF(t0_pin); break;
+	case K_JNT1: JUMP_IF(!t1_pin); break;
+	case K_JT1: JUMP_IF(t1_pin); break;
+	case K_JF1: JUMP_IF(f1); break;
+	case K_JNI: JUMP_IF(!int_pin); break;
+	case K_JNZ: JUMP_IF(acc != 0); break;
+	case K_JF0: JUMP_IF(psw & PSW_F0); break;
+	case K_JZ: JUMP_IF(acc == 0); break;
+	case K_JNC: JUMP_IF(!(psw & PSW_CY)); break;
+	case K_JC: JUMP_IF(psw & PSW_CY); break;
+	case K_JB: JUMP_IF(acc & (1 << (code >> 5))); break;
+
+	case K_JMP:
+		pc = (in_irq ? 0 : mb) | ((code & 0xE0) << 3) | arg;
+		if (pc == addr && !(int_enabled && !int_pin) && !(tcnti_enabled && timer_mode)) {
+			fprintf(stderr, "Halted at %s\n", addr_name(addr));
+			return 0;
+		}
+		break;
+
+	case K_JMPP: pc = (pc & 0xF00) | rom[(pc & 0xF00) | acc]; break;
+
+	case K_MOV_A_I: acc = arg; break;
+	case K_MOV_A_R: acc = REG(code & 7); break;
+	case K_MOV_A_M: acc = IND(code & 1); break;
+	case K_MOV_A_PSW: acc = psw | 0x08; break;
+	case K_MOV_R_I: REG(code & 7) = arg; break;
+	case K_MOV_R_A: REG(code & 7) = acc; break;
+	case K_MOV_M_A: IND(code & 1) = acc; break;
+	case K_MOV_M_I: IND(code & 1) = arg; break;
+	case K_MOV_PSW_A: psw = acc & ~0x08; break;
+	case K_MOVD_A_P: acc = exp_port[4 + (code & 3)] & 0x0F; break;
+	case K_MOVD_P_A: exp_port[4 + (code & 3)] = acc & 0x0F; break;
+	case K_MOV_A_T: acc = timer; break;
+	case K_MOV_T_A: timer = acc; break;
+	case K_MOVP3: acc = rom[0x300 | acc]; break;
+	case K_MOVP: acc = rom[(pc & 0xF00) | acc]; break;
+	case K_MOVX_A_M: acc = xram[REG(code & 1)]; break;
+	case K_MOVX_M_A: xram[REG(code & 1)] = acc; break;
+
+	case K_ORL_R: acc |= REG(code & 7); break;
+	case K_ORL_M: acc |= IND(code & 1); break;
+	case K_ORL_I: acc |= arg; break;
+	case K_ORL_BUS: port_out[0] |= arg; break;
+	case K_ORL_P1: port_out[1] |= arg; break;
+	case K_ORL_P2: port_out[2] |= arg; break;
+	case K_ORLD: exp_port[4 + (code & 3)] |= acc & 0x0F; break;
+	case K_OUTL_BUS: port_out[0] = acc; break;
+	case K_OUTL_P1: port_out[1] = acc; break;
+	case K_OUTL_P2: port_out[2] = acc; break;
+
+	case K_RET: pc = pop_pc(0); break;
+	case K_RETR: pc = pop_pc(1); in_irq = 0; break;
+
+	case K_RL: acc = ((acc << 1) | (acc >> 7)) & 0xFF; break;
+	case K_RLC:
+		t = acc >> 7;
+		acc = ((acc << 1) | ((psw & PSW_CY) != 0)) & 0xFF;
+		psw = t ? (psw | PSW_CY) : (psw & ~PSW_CY);
+		break;
+	case K_RR: acc = ((acc >> 1) | (acc << 7)) & 0xFF; break;
+	case K_RRC:
+		t = acc & 1;
+		acc = (acc >> 1) | ((psw & PSW_CY) ? 0x80 : 0);
+		psw = t ? (psw | PSW_CY) : (psw & ~PSW_CY);
+		break;
+
+	case K_SEL_MB0: mb = 0; break;
+	case K_SEL_MB1: mb = 0x800; break;
+	case K_SEL_RB0: psw &= ~PSW_BS; break;
+	case K_SEL_RB1: psw |= PSW_BS; break;
+	case K_STOP: timer_mode = 0; break;
+	case K_STRT_CNT: timer_mode = 2; break;
+	case K_STRT_T: timer_mode = 1; prescaler = 0; break;
+	case K_SWAP: acc = ((acc << 4) | (acc >> 4)) & 0xFF; break;
+
+	case K_XCH_R: t = acc; acc = REG(code & 7); REG(code & 7) = t; break;
+	case K_XCH_M: t = acc; acc = IND(code & 1); IND(code & 1) = t; break;
+	case K_XCHD:
+		t = IND(code & 1);
+		IND(code & 1) = (t & 0xF0) | (acc & 0x0F);
+		acc = (acc & 0xF0) | (t & 0x0F);
+		break;
+
+	case K_XRL_I: acc ^= arg; break;
+	case K_XRL_R: acc ^= REG(code & 7); break;
+	case K_XRL_M: acc ^= IND(code & 1); break;
+
+	case K_NOP: break;
+	}
+
+	n = d->cycles;
+	hits[addr]++;
+	cycles[addr] += n;
+	total_ins++;
+
+	n += check_interrupts();
+	total_cycles += n;
+	if (timer_mode == 1)
+		run_timer(n);
+	return 1;
+}
+
+/*
+ * Print one line of trace output for the instruction at the PC.
+ */
+static void trace(void)
+{
+	char buf[64];
+
+	Dasm8039(buf, pc);
+	printf("%10llu  %03X  %-16s A=%02X PSW=%02X  %s\n",
+		total_cycles, pc, buf, acc, psw | 0x08, addr_name(pc));
+}
+
+/*
+ * A row of the profile.
+ */
+struct Row {
+	int addr;
+	const char *name;
+	unsigned long entries, count;
+	unsigned long long cycles;
+};
+
+static int cmp_row(const void *a, const void *b)
+{
+	const struct Row *ra = a, *rb = b;
+	if (ra->cycles != rb->cycles)
+		return ra->cycles < rb->cycles ? 1 : -1;
+	return ra->addr - rb->addr;
+}
+
+/*
+ * Print the hottest addresses and the time spent under each label.
+ */
+static void print_profile(int max_hot)
+{
+	struct Row *rows = malloc((ROM_SIZE + num_labels + 1) * sizeof(struct Row));
+	struct Label *label;
+	double total = total_cycles ? (double) total_cycles : 1.0;
+	int i, n = 0, code;
+	char buf[64];
+
+	if (rows == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < ROM_SIZE; i++) {
+		if (hits[i] == 0)
+			continue;
+		rows[n].addr = i;
+		rows[n].count = hits[i];
+		rows[n].cycles = cycles[i];
+		n++;
+	}
+	qsort(rows, n, sizeof(struct Row), &cmp_row);
+
+	printf("\n   Hot spots:\n");
+	printf(" addr  %-24s %-18s %10s %12s %6s\n", "location", "instruction", "count", "cycles", "%");
+	for (i = 0; i < n && i < max_hot; i++) {
+		code = rows[i].addr;
+		Dasm8039(buf, code);
+		printf(" %03X   %-24s %-18s %10lu %12llu %5.1f%%\n", code, addr_name(code), buf,
+			rows[i].count, rows[i].cycles, rows[i].cycles * 100.0 / total);
+	}
+
+	if (num_labels == 0)
+		return;
+
+	/* Charge each address to the label at or before it. */
+	n = 0;
+	for (i = 0; i < num_labels; i++) {
+		if (i > 0 && labels[i].addr == labels[i - 1].addr)
+			continue;
+		rows[n].addr = labels[i].addr;
+		rows[n].name = labels[i].name;
+		rows[n].entries = hits[labels[i].addr];
+		rows[n].count = 0;
+		rows[n].cycles = 0;
+		n++;
+	}
+	for (i = 0; i < ROM_SIZE; i++) {
+		if (hits[i] == 0 || (label = find_label(i)) == NULL)
+			continue;
+		for (code = 0; code < n && rows[code].addr != label->addr; code++)
+			;
+		rows[code].count += hits[i];
+		rows[code].cycles += cycles[i];
+	}
+	qsort(rows, n, sizeof(struct Row), &cmp_row);
+
+	printf("\n   Profile by label:\n");
+	printf(" addr  %-24s %10s %12s %12s %6s\n", "label", "entries", "instructions", "cycles", "%");
+	for (i = 0; i < n && rows[i].cycles > 0; i++) {
+		printf(" %03X   %-24s %10lu %12lu %12llu %5.1f%%\n", rows[i].addr, rows[i].name,
+			rows[i].entries, rows[i].count, rows[i].cycles, rows[i].cycles * 100.0 / total);
+	}
+	free(rows);
+}
+
+/*
+ * main() function.
+ */
+int main(int argc, char **argv)
+{
+	const char *image_file, *stop = NULL;
+	unsigned long long max_cycles = DEFAULT_CYCLES;
+	int opt, stop_addr = -1, tracing = 0, max_hot = 0, ram_size;
+	size_t size;
+	FILE *fp;
+
+	opterr = 0;
+	while ((opt = getopt(argc, argv, "s:n:b:r:p:t")) != -1) {
+		switch (opt) {
+			case 's':
+				read_symbols(optarg, add_symbol);
+				qsort(labels, num_labels, sizeof(struct Label), &cmp_label);
+				break;
+			case 'n':
+				max_cycles = strtoull(optarg, NULL, 0);
+				break;
+			case 'b':
+				stop = optarg;
+				break;
+			case 'r':
+				ram_size = atoi(optarg);
+				if (ram_size != 64 && ram_size != 128 && ram_size != 256) {
+					fprintf(stderr, "RAM size must be 64, 128 or 256\n");
+					exit(1);
+				}
+				ram_mask = ram_size - 1;
+				break;
+			case 'p':
+				max_hot = atoi(optarg);
+				if (max_hot <= 0)
+					max_hot = DEFAULT_HOT;
+				break;
+			case 't':
+				tracing = 1;
+				break;
+			case '?':
+				fprintf(stderr, "Unknown option '%c'\n", optopt);
+				usage();
+				exit(1);
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		exit(1);
+	}
+	image_file = argv[optind];
+	if (stop != NULL)
+		stop_addr = parse_addr(stop);
+
+	fp = fopen(image_file, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "Couldn't open %s: %s\n", image_file, strerror(errno));
+		exit(1);
+	}
+	size = fread(rom, 1, ROM_SIZE, fp);
+	fclose(fp);
+	if (size == 0) {
+		fprintf(stderr, "Image file %s is empty\n", image_file);
+		exit(1);
+	}
+
+	init_decoder();
+	SetCode8039(rom);
+
+	while (total_cycles < max_cycles && pc != stop_addr) {
+		if (tracing)
+			trace();
+		if (!step())
+			break;
+	}
+
+	fprintf(stderr, "Stopped at %s after %llu cycles (%llu instructions)\n",
+		addr_name(pc), total_cycles, total_ins);
+	if (max_hot > 0)
+		print_profile(max_hot);
+	return 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Unreachable code and data removal (-u).  Code is followed from
+ * the reset and interrupt vectors and from exported symbols through
+ * jumps, calls and branches.  Labels named by the operands of the
+ * code reached keep their code, or the whole run of data they
+ * start or fall in.  Everything else is dropped before the final
+ * layout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asm48.h"
+#include "parse.tab.h"
+
+/* Data starting at each address; code is in code_at[]. */
+static struct Instruction **data_at;
+
+/* Nonzero for each instruction reached. */
+static unsigned char *live;
+
+/* First and last address of the run of data holding each address. */
+static int *run_start, *run_end;
+
+/* Worklist of code addresses. */
+static int *work;
+static int num_work;
+
+/*
+ * Index the laid out program by address.
+ */
+static void init_strip(void)
+{
+	struct Section *sect;
+	struct Instruction *ins;
+	int start = -1, end = -1, addr;
+
+	index_code();
+	data_at = calloc(MAX_ADDR, sizeof(struct Instruction *));
+	live = calloc(MAX_ADDR, 1);
+	run_start = malloc(MAX_ADDR * sizeof(int));
+	run_end = malloc(MAX_ADDR * sizeof(int));
+	work = malloc(MAX_ADDR * sizeof(int));
+	if (data_at == NULL || live == NULL || run_start == NULL || run_end == NULL || work == NULL)
+		err_printf("Unable to allocate reachability tables\n");
+	num_work = 0;
+
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		for (ins = sect->head; ins != NULL; ins = ins->next) {
+			if (ins->type == INS_LABEL)
+				continue;
+			if (ins->type != INS_DATA) {
+				start = -1;
+				continue;
+			}
+			if (ins->size > 0 && ins->offset >= 0 && ins->offset + ins->size <= MAX_ADDR) {
+				data_at[ins->offset] = ins;
+				if (start < 0)
+					start = ins->offset;
+				end = ins->offset + ins->size;
+				for (addr = start; addr < end; addr++) {
+					run_start[addr] = start;
+					run_end[addr] = end;
+				}
+			}
+		}
+		start = -1;
+	}
+}
+
+/*
+ * Keep the code at an address, and queue it to be followed.
+ */
+static void push(int addr)
+{
+	if (addr >= 0 && addr < MAX_ADDR && code_at[addr] != NULL && !live[addr]) {
+		live[addr] = 1;
+		work[num_work++] = addr;
+	}
+}
+
+static void reference(int addr);
+
+/*
+ * Follow the labels an expression names.
+ */
+static void expr_references(struct Expr *expr)
+{
+	struct Symbol *sym;
+
+	if (expr == NULL)
+		return;
+	if (expr->op == IDENTIFIER) {
+		if (expr->mark != NULL) {
+			reference(expr->mark->offset);
+		} else {
+			sym = lookup_symbol(expr->sym);
+			if (sym != NULL && sym->expr != NULL)	/* .equ of a label */
+				expr_references(sym->expr);
+			else if (sym != NULL && sym->type == SYMB_LABEL)
+				reference(sym->ins != NULL ? sym->ins->offset : sym->value);
+		}
+		return;
+	}
+	expr_references(expr->left);
+	expr_references(expr->right);
+}
+
+/*
+ * Keep the run of data holding an address.
+ */
+static void keep_data(int addr)
+{
+	int i;
+
+	if (addr < 0 || addr >= MAX_ADDR || data_at[addr] == NULL || live[addr])
+		return;
+	for (i = run_start[addr]; i < run_end[addr]; i++) {
+		if (data_at[i] != NULL && !live[i]) {
+			live[i] = 1;
+			expr_references(data_at[i]->expr);
+		}
+	}
+}
+
+/*
+ * Keep whatever a label names: code or a run of data.
+ */
+static void reference(int addr)
+{
+	if (addr < 0 || addr >= MAX_ADDR)
+		return;
+	if (code_at[addr] != NULL)
+		push(addr);
+	else
+		keep_data(addr);
+}
+
+/*
+ * Follow the code from the queued addresses.
+ */
+static void follow(void)
+{
+	struct Instruction *ins;
+	int addr, target, targets[256], n, i;
+
+	while (num_work > 0) {
+		addr = work[--num_work];
+		ins = code_at[addr];
+		expr_references(ins->expr);
+
+		switch (instruction_flow(ins, &target)) {
+			case FLOW_NEXT:
+				push(addr + ins->size);
+				break;
+			case FLOW_JUMP:
+				push(target);
+				break;
+			case FLOW_BRANCH:
+			case FLOW_CALL:
+				push(target);
+				push(addr + ins->size);
+				break;
+			case FLOW_RET:
+				break;
+			case FLOW_INDIRECT:
+				n = jump_table_targets(ins, targets, 256);
+				if (n < 0) {
+					/* Without a .jumptable, keep all code in the page. */
+					for (i = addr & PAGE_MASK; i < (addr & PAGE_MASK) + 256 && i < MAX_ADDR; i++)
+						push(i);
+					break;
+				}
+				keep_data(addr + ins->size);
+				for (i = 0; i < n; i++)
+					push(targets[i]);
+				break;
+		}
+	}
+}
+
+/*
+ * Remove the code and data not reached from the vectors and the
+ * exported symbols, and print what was removed with its address
+ * and the label before it.  Only ROM bank 0 is stripped; what the
+ * other banks refer to in it is kept.
+ */
+void strip_unreachable(void)
+{
+	struct Section *sect;
+	struct Instruction *ins, *prev, *next;
+	struct Symbol *sym;
+	struct RamVar *var;
+	const char *name, *shown = NULL;
+	int i, addr, start = 0, bytes = 0, total = 0;
+
+	init_strip();
+	for (i = 0; i < NUM_VECTORS; i++)
+		push(routine_vectors[i]);
+	for (sym = first_symbol(); sym != NULL; sym = sym->next) {
+		if ((sym->flags & SYMF_EXPORT) && sym->type == SYMB_LABEL)
+			reference(sym->ins != NULL ? sym->ins->offset : sym->value);
+	}
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		if (sect->rom_bank == 0)
+			continue;
+		for (ins = sect->head; ins != NULL; ins = ins->next)
+			expr_references(ins->expr);
+	}
+	follow();
+
+	/* The variables of a routine removed go with it. */
+	for (var = ram_vars; var != NULL; var = var->next) {
+		addr = var->mark->offset;
+		if (addr >= 0 && addr < MAX_ADDR && code_at[addr] != NULL && !live[addr])
+			var->dead = 1;
+	}
+
+	printf("   Unreachable code and data removed:\n");
+	for (sect = sect_head; sect != NULL; sect = sect->next) {
+		name = sect->name;
+		prev = NULL;
+		for (ins = sect->head; ins != NULL; ins = next) {
+			next = ins->next;
+			if (ins->type == INS_LABEL && ins->sym != NULL)
+				name = ins->sym->name;
+			if (ins->offset < 0 || ins->offset >= MAX_ADDR || (code_at[ins->offset] != ins && data_at[ins->offset] != ins)
+					|| live[ins->offset]) {
+				prev = ins;
+				continue;
+			}
+			if (bytes > 0 && (shown != name || ins->offset != start + bytes)) {
+				printf("   %03X %-24s %4d bytes\n", start, shown, bytes);
+				bytes = 0;
+			}
+			if (bytes == 0)
+				start = ins->offset;
+			shown = name;
+			bytes += ins->size;
+			total += ins->size;
+			if (prev != NULL)
+				prev->next = next;
+			else
+				sect->head = next;
+			if (sect->tail == ins)
+				sect->tail = prev;
+		}
+	}
+	if (bytes > 0)
+		printf("   %03X %-24s %4d bytes\n", start, shown, bytes);
+	printf("   %d bytes removed\n", total);
+
+	free(data_at);
+	free(live);
+	free(run_start);
+	free(run_end);
+	free(work);
+}
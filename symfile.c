@@ -0,0 +1,88 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Reader for the symbols files asm48 writes with -s (text) and
+ * -S (binary), shared by 8039dasm and sim48.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "8039dasm.h"
+
+/*
+ * Read the labels and constants of a symbols file, passing each
+ * to add() with whether it is a label.  Exits if the file can't
+ * be read.
+ */
+void read_symbols(const char *filename, void (*add)(const char *name, unsigned long value, int is_label))
+{
+	static const char magic[] = "SYM48\1";
+	unsigned char hdr[6];
+	char line[512], name[256];
+	unsigned long value;
+	long count;
+	int is_label = 0;
+	FILE *fp = fopen(filename, "rb");
+
+	if (fp == NULL) {
+		fprintf(stderr, "Couldn't open symbols file %s: %s\n", filename, strerror(errno));
+		exit(1);
+	}
+
+	if (fread(hdr, 1, 6, fp) == 6 && memcmp(hdr, magic, 6) == 0) {
+		if (fread(hdr, 1, 4, fp) != 4)
+			goto truncated;
+		count = hdr[0] | (hdr[1] << 8) | ((long) hdr[2] << 16) | ((long) hdr[3] << 24);
+		while (count-- > 0) {
+			if (fread(hdr, 1, 6, fp) != 6 || fread(name, 1, hdr[5], fp) != hdr[5])
+				goto truncated;
+			name[hdr[5]] = '\0';
+			value = hdr[1] | (hdr[2] << 8) | ((unsigned long) hdr[3] << 16) | ((unsigned long) hdr[4] << 24);
+			add(name, value, hdr[0] == 1);	/* SYMB_LABEL */
+		}
+	} else {
+		rewind(fp);
+		while (fgets(line, sizeof(line), fp) != NULL) {
+			if (line[0] == ';') {
+				is_label = strstr(line, "Labels") != NULL;
+				continue;
+			}
+			if (sscanf(line, "%lx %255s", &value, name) == 2)
+				add(name, value, is_label);
+		}
+	}
+
+	fclose(fp);
+	return;
+
+truncated:
+	fprintf(stderr, "Symbols file %s is truncated\n", filename);
+	exit(1);
+}
@@ -32,9 +32,27 @@
 #include <errno.h>
 #include "asm48.h"
 
-/* FIXME: currently a linked list. Should change to a hash table. */
+/* All symbols, most recently defined first. */
 static struct Symbol *sym_head;
 
+/* Hash table for symbol lookup. */
+#define SYM_HASH_SIZE 4096
+static struct Symbol *sym_hash[SYM_HASH_SIZE];
+
+/* Magic number at the start of a binary symbols file. */
+static const char sym_magic[] = "SYM48\1";
+
+/*
+ * Names listed by .export, resolved once parsing is complete.
+ */
+struct Export {
+	const char *name;
+	int line_num;
+	char *cur_file;
+	struct Export *next;
+};
+static struct Export *export_head;
+
 /*
  * Allocate a duplicate of given string from the string pool.
  */
@@ -47,46 +65,161 @@ const char *dup_str(const char *str)
 }
 
 /*
- * Define a symbol.
+ * Hash a symbol name (FNV-1a).
  */
-void define_symbol(const char *name, int value, int type)
+static unsigned hash_name(const char *name)
 {
-	struct Symbol *sym;
+	unsigned h = 2166136261u;
+	while (*name)
+		h = (h ^ (unsigned char) *name++) * 16777619u;
+	return h % SYM_HASH_SIZE;
+}
+
+/*
+ * Allocate a new symbol and enter it into the table.
+ */
+static struct Symbol *new_symbol(const char *name, int value, int type)
+{
+	struct Symbol *sym = pool_alloc_buf(gen_pool, sizeof(struct Symbol));
+	unsigned h = hash_name(name);
 
-	sym = lookup_symbol(name);
-	if (sym != NULL)
-		err_printf("Redefinition of symbol %s\n", name);
-	sym = pool_alloc_buf(gen_pool, sizeof(struct Symbol));
 	sym->name = dup_str(name);
 	sym->value = value;
 	sym->type = type;
+	sym->flags = 0;
+	sym->ins = NULL;
+	sym->expr = NULL;
 
 	sym->next = sym_head;
 	sym_head = sym;
+	sym->hash_next = sym_hash[h];
+	sym_hash[h] = sym;
+	return sym;
 }
 
 /*
- * Re-define a symbol.
+ * Define a symbol.
  */
-void redefine_symbol(const char *name, int value, int type)
+struct Symbol *define_symbol(const char *name, int value, int type)
 {
 	struct Symbol *sym;
 
 	sym = lookup_symbol(name);
-	if (sym == NULL) {
-		sym = pool_alloc_buf(gen_pool, sizeof(struct Symbol));
-		sym->name = dup_str(name);
-		sym->value = value;
-		sym->type = type;
+	if (sym != NULL && (sym->flags & SYMF_READONLY)) {
+		error_at(cur_file, parse_src_line, 0, "Symbol %s is imported and can't be redefined", name);
+		return NULL;
+	}
+	if (sym != NULL) {
+		error_at(cur_file, parse_src_line, 0, "Redefinition of symbol %s", name);
+		return NULL;
+	}
+	return new_symbol(name, value, type);
+}
+
+/*
+ * Define a label at the current position.  The label follows
+ * its marker when the section is placed or laid out again.
+ */
+void define_label(const char *name)
+{
+	struct Symbol *sym = define_symbol(name, cur_offset, SYMB_LABEL);
+	if (sym == NULL)
+		return;
+	sym->ins = mark();
+	sym->ins->sym = sym;
+}
+
+/*
+ * Mark a symbol for export (.export directive).  The symbol
+ * may be defined later in the source.
+ */
+void export_symbol(const char *name, int line_num)
+{
+	struct Export *exp = pool_alloc_buf(gen_pool, sizeof(struct Export));
+	exp->name = dup_str(name);
+	exp->line_num = line_num;
+	exp->cur_file = cur_file;
+	exp->next = export_head;
+	export_head = exp;
+}
+
+/*
+ * Flag all symbols named by .export directives.
+ */
+void resolve_exports(void)
+{
+	struct Export *exp;
+	struct Symbol *sym;
+
+	for (exp = export_head; exp != NULL; exp = exp->next) {
+		sym = lookup_symbol(exp->name);
+		if (sym == NULL) {
+			error_at(exp->cur_file, exp->line_num, 0, "Exported symbol '%s' is not defined", exp->name);
+			continue;
+		}
+		sym->flags |= SYMF_EXPORT;
+	}
+}
+
+/*
+ * Re-define a symbol.  Returns NULL if it can't be changed.
+ */
+struct Symbol *redefine_symbol(const char *name, int value, int type)
+{
+	struct Symbol *sym;
 
-		sym->next = sym_head;
-		sym_head = sym;
+	sym = lookup_symbol(name);
+	if (sym == NULL) {
+		sym = new_symbol(name, value, type);
 	} else {
-		if (sym->type != type)
-			err_printf("Symbol %s type conflict\n", name);
+		if (sym->flags & SYMF_READONLY) {
+			error_at(cur_file, parse_src_line, 0, "Symbol %s is imported and can't be changed", name);
+			return NULL;
+		}
+		if (sym->type != type) {
+			error_at(cur_file, parse_src_line, 0, "Symbol %s type conflict", name);
+			return NULL;
+		}
 
 		sym->value = value;
 	}
+	return sym;
+}
+
+/*
+ * Define a constant (.equ), or change it if redefine is nonzero
+ * (.set); without an expression it is 1.  A value that refers to
+ * labels is kept as an expression, since sections are placed and
+ * code moved after parsing, and evaluated wherever it is used.
+ */
+void define_equate(const char *name, struct Expr *expr, int redefine)
+{
+	struct Expr *bound = NULL;
+	struct Symbol *sym;
+	int value = 1;
+
+	if (expr != NULL) {
+		value = eval_expr(cur_file, expr);
+		if (expr_is_defined(expr) && expr_refers_to_label(expr))
+			bound = bind_expr(expr);
+	}
+	sym = redefine ? redefine_symbol(name, value, SYMB_CONST) : define_symbol(name, value, SYMB_CONST);
+	if (sym != NULL)
+		sym->expr = bound;
+}
+
+/*
+ * Bring the values of the constants that refer to labels up to
+ * date once the program is laid out, for the symbols files.
+ */
+void update_equates(void)
+{
+	struct Symbol *sym;
+
+	for (sym = sym_head; sym != NULL; sym = sym->next) {
+		if (sym->expr != NULL)
+			sym->value = eval_expr(cur_file, sym->expr);
+	}
 }
 
 /*
@@ -95,17 +228,26 @@ void redefine_symbol(const char *name, int value, int type)
  */
 struct Symbol *lookup_symbol(const char *name)
 {
-	struct Symbol *cur = sym_head;
+	struct Symbol *cur = sym_hash[hash_name(name)];
 
 	while (cur != NULL) {
 		if (strcmp(cur->name, name) == 0)
 			break;
-		cur = cur->next;
+		cur = cur->hash_next;
 	}
 
 	return cur;
 }
 
+/*
+ * Return the most recently defined symbol; the others
+ * follow through the next links.
+ */
+struct Symbol *first_symbol(void)
+{
+	return sym_head;
+}
+
 /*
  * Export symbols into a file stream.
  */
@@ -133,3 +275,131 @@ void export_symbols(const char *filename)
 
 	fclose(f);
 }
+
+/*
+ * Export symbols into a compact binary file: the magic number,
+ * a 32 bit symbol count, then per symbol its type byte, 32 bit
+ * value, name length byte and name.  Numbers are little endian.
+ */
+void export_symbols_bin(const char *filename)
+{
+	struct Symbol *cur;
+	unsigned char hdr[6];
+	long count = 0;
+	size_t len;
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		err_printf("Couldn't open symbols file %s: %s\n", filename, strerror(errno));
+	}
+
+	for (cur = sym_head; cur != NULL; cur = cur->next)
+		count++;
+
+	fwrite(sym_magic, 1, sizeof(sym_magic) - 1, f);
+	hdr[0] = count; hdr[1] = count >> 8; hdr[2] = count >> 16; hdr[3] = count >> 24;
+	fwrite(hdr, 1, 4, f);
+
+	for (cur = sym_head; cur != NULL; cur = cur->next) {
+		len = strlen(cur->name);
+		if (len > 255)
+			err_printf("Symbol name %s is too long for a binary symbols file\n", cur->name);
+		hdr[0] = cur->type;
+		hdr[1] = cur->value; hdr[2] = cur->value >> 8; hdr[3] = cur->value >> 16; hdr[4] = cur->value >> 24;
+		hdr[5] = len;
+		fwrite(hdr, 1, 6, f);
+		fwrite(cur->name, 1, len, f);
+	}
+
+	if (ferror(f))
+		err_printf("Failed to write symbols file %s: %s\n", filename, strerror(errno));
+	fclose(f);
+}
+
+/*
+ * Define an imported symbol.  Imported symbols are read-only.
+ */
+static void import_symbol(const char *name, int value, int type)
+{
+	struct Symbol *sym = define_symbol(name, value, type);
+	if (sym != NULL)
+		sym->flags |= SYMF_READONLY;
+}
+
+/*
+ * Import symbols from a binary symbols file already read into memory.
+ */
+static void import_symbols_bin(const char *filename, const unsigned char *buf, long size)
+{
+	const unsigned char *p = buf + sizeof(sym_magic) - 1, *end = buf + size;
+	char name[256];
+	long count;
+	int value, len;
+
+	if (end - p < 4)
+		err_printf("Symbols file %s is truncated\n", filename);
+	count = p[0] | (p[1] << 8) | ((long) p[2] << 16) | ((long) p[3] << 24);
+	p += 4;
+
+	while (count-- > 0) {
+		if (end - p < 6 || end - p < 6 + p[5])
+			err_printf("Symbols file %s is truncated\n", filename);
+		value = p[1] | (p[2] << 8) | (p[3] << 16) | ((unsigned) p[4] << 24);
+		len = p[5];
+		memcpy(name, p + 6, len);
+		name[len] = '\0';
+		import_symbol(name, value, p[0] == SYMB_LABEL ? SYMB_LABEL : SYMB_CONST);
+		p += 6 + len;
+	}
+}
+
+/*
+ * Import symbols from a file written by export_symbols() or
+ * export_symbols_bin(), e.g. the entry points of a ROM that
+ * is not part of this build.
+ */
+void import_symbols(const char *filename)
+{
+	FILE *f = fopen(filename, "rb");
+	unsigned char *buf;
+	char *line, *next, name[256];
+	unsigned long value;
+	long size;
+	int type = SYMB_CONST;
+
+	if (!f)
+		err_printf("Couldn't open symbols file %s: %s\n", filename, strerror(errno));
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = malloc(size + 1);
+	if (buf == NULL)
+		err_printf("Unable to allocate %ld bytes for symbols file %s\n", size, filename);
+	if (fread(buf, 1, size, f) != size)
+		err_printf("Couldn't read symbols file %s: %s\n", filename, strerror(errno));
+	buf[size] = '\0';
+	fclose(f);
+
+	if (size >= sizeof(sym_magic) - 1 && memcmp(buf, sym_magic, sizeof(sym_magic) - 1) == 0) {
+		import_symbols_bin(filename, buf, size);
+		free(buf);
+		return;
+	}
+
+	for (line = (char *) buf; line != NULL; line = next) {
+		next = strchr(line, '\n');
+		if (next != NULL)
+			*next++ = '\0';
+		if (line[0] == ';') {
+			if (strstr(line, "Labels") != NULL)
+				type = SYMB_LABEL;
+			else if (strstr(line, "Constants") != NULL)
+				type = SYMB_CONST;
+			continue;
+		}
+		if (sscanf(line, "%lx %255s", &value, name) == 2)
+			import_symbol(name, (int) value, type);
+	}
+
+	free(buf);
+}
@@ -0,0 +1,229 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Regression tests for the passes that move code after parsing.
+ * Each .asm file assembles on its own and says what to expect in
+ * comments at the start of a line:
+ *
+ *	;; asm48 <options>		command line options (-s and -o are added)
+ *	;; expect <addr> <bytes>	hex bytes of the image from hex addr on
+ *	;; size <n>			hex size of the image
+ *	;; symbol <name> <value>	hex value in the symbols file
+ *	;; output <text>		text asm48 prints
+ *	;; error <text>			asm48 must fail and print the text
+ *
+ * Run by "make test":
+ *
+ *	asmtest <asm48 command> <file.asm> ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE 512
+#define MAX_IMAGE 0x10000
+
+#define BIN_FILE "asmtest.bin"
+#define SYM_FILE "asmtest.sym"
+#define LOG_FILE "asmtest.log"
+
+static const char *assembler;
+static unsigned char image[MAX_IMAGE];
+static int image_size;
+static int errors;
+
+/*
+ * Report a failed expectation of a test file.
+ */
+static void fail(const char *file, int line_num, const char *text)
+{
+	printf("%s:%d: %s\n", file, line_num, text);
+	errors++;
+}
+
+/*
+ * Does a file contain a line with the text?
+ */
+static int file_has(const char *filename, const char *text)
+{
+	char line[MAX_LINE];
+	int found = 0;
+	FILE *fp = fopen(filename, "r");
+
+	if (fp == NULL)
+		return 0;
+	while (!found && fgets(line, sizeof(line), fp) != NULL)
+		found = strstr(line, text) != NULL;
+	fclose(fp);
+	return found;
+}
+
+/*
+ * Look up a symbol in the symbols file written by -s.
+ * Returns nonzero if it is there.
+ */
+static int symbol_value(const char *name, unsigned long *value)
+{
+	char line[MAX_LINE], sym[MAX_LINE];
+	int found = 0;
+	FILE *fp = fopen(SYM_FILE, "r");
+
+	if (fp == NULL)
+		return 0;
+	while (!found && fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%lx %s", value, sym) == 2 && strcmp(sym, name) == 0)
+			found = 1;
+	}
+	fclose(fp);
+	return found;
+}
+
+/*
+ * Compare the image with the hex bytes expected from addr on.
+ */
+static void expect_bytes(const char *file, int line_num, char *p)
+{
+	char msg[MAX_LINE];
+	unsigned addr, byte;
+	int n;
+
+	if (sscanf(p, "%x %n", &addr, &n) != 1) {
+		fail(file, line_num, "bad expect line");
+		return;
+	}
+	for (p += n; sscanf(p, "%x %n", &byte, &n) == 1; p += n, addr++) {
+		if ((int) addr >= image_size) {
+			sprintf(msg, "%03X: past the end of the %d byte image", addr, image_size);
+			fail(file, line_num, msg);
+			return;
+		}
+		if (image[addr] != byte) {
+			sprintf(msg, "%03X: %02X instead of %02X", addr, image[addr], byte);
+			fail(file, line_num, msg);
+		}
+	}
+}
+
+/*
+ * Assemble a test file and check what it expects.
+ */
+static void run_test(const char *file)
+{
+	char line[MAX_LINE], cmd[2 * MAX_LINE], msg[2 * MAX_LINE], word[MAX_LINE], options[MAX_LINE] = "";
+	unsigned long want, got;
+	int line_num, status, should_fail = 0, n;
+	FILE *fp = fopen(file, "r");
+
+	if (fp == NULL) {
+		printf("Couldn't open %s\n", file);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (strncmp(line, ";; asm48", 8) == 0)
+			strcpy(options, line + 8);
+		else if (strncmp(line, ";; error", 8) == 0)
+			should_fail = 1;
+	}
+	options[strcspn(options, "\r\n")] = '\0';
+
+	remove(BIN_FILE);
+	remove(SYM_FILE);
+	sprintf(cmd, "%s %s -s %s -o %s %s > %s 2>&1", assembler, options, SYM_FILE, BIN_FILE, file, LOG_FILE);
+	status = system(cmd);
+	if (should_fail != (status != 0)) {
+		fail(file, 1, should_fail ? "asm48 succeeded" : "asm48 failed, see " LOG_FILE);
+		fclose(fp);
+		return;
+	}
+
+	image_size = 0;
+	if (!should_fail) {
+		FILE *bin = fopen(BIN_FILE, "rb");
+
+		if (bin != NULL) {
+			image_size = fread(image, 1, sizeof(image), bin);
+			fclose(bin);
+		}
+	}
+
+	rewind(fp);
+	for (line_num = 1; fgets(line, sizeof(line), fp) != NULL; line_num++) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (strncmp(line, ";; ", 3) != 0 || sscanf(line + 3, "%s %n", word, &n) != 1)
+			continue;
+		if (strcmp(word, "expect") == 0) {
+			expect_bytes(file, line_num, line + 3 + n);
+		} else if (strcmp(word, "size") == 0) {
+			want = strtoul(line + 3 + n, NULL, 16);
+			if (image_size != (int) want) {
+				sprintf(msg, "image of %X bytes instead of %lX", image_size, want);
+				fail(file, line_num, msg);
+			}
+		} else if (strcmp(word, "symbol") == 0) {
+			if (sscanf(line + 3 + n, "%s %lx", word, &want) != 2) {
+				fail(file, line_num, "bad symbol line");
+			} else if (!symbol_value(word, &got)) {
+				sprintf(msg, "no symbol %s", word);
+				fail(file, line_num, msg);
+			} else if (got != want) {
+				sprintf(msg, "%s is %lX instead of %lX", word, got, want);
+				fail(file, line_num, msg);
+			}
+		} else if (strcmp(word, "output") == 0 || strcmp(word, "error") == 0) {
+			if (!file_has(LOG_FILE, line + 3 + n)) {
+				sprintf(msg, "no '%s' in the output", line + 3 + n);
+				fail(file, line_num, msg);
+			}
+		}
+	}
+	fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	if (argc < 3) {
+		fprintf(stderr, "Usage: asmtest <asm48 command> <file.asm> ...\n");
+		exit(1);
+	}
+	assembler = argv[1];
+	for (i = 2; i < argc; i++)
+		run_test(argv[i]);
+
+	if (errors > 0) {
+		printf("%d failed checks\n", errors);
+		return 1;
+	}
+	printf("%d test files pass\n", argc - 2);
+	remove(BIN_FILE);
+	remove(SYM_FILE);
+	remove(LOG_FILE);
+	return 0;
+}
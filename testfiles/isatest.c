@@ -0,0 +1,264 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks that the assembler (parse.y) and the disassembler
+ * (Formats[] in 8039dasm.c) agree on the instruction set.  Every
+ * encoding the disassembler knows, with every operand value, is
+ * disassembled, assembled again by asm48 and must come out as the
+ * same bytes.  So must random byte streams, and the spellings only
+ * the assembler knows.  Run by "make test":
+ *
+ *	isatest <asm48 command> [<seed> [<streams>]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "8039dasm.h"
+
+#define CHUNK_SIZE 4096		/* Bytes assembled at a time. */
+#define PROLOGUE 8		/* "ret" at the vectors, so no analysis follows the code. */
+#define DEFAULT_STREAMS 32	/* Random byte streams. */
+#define MAX_REPORTS 20		/* Differences listed. */
+
+#define SRC_FILE "isatest.asm"
+#define BIN_FILE "isatest.bin"
+#define LOG_FILE "isatest.log"
+
+/* Spellings the disassembler doesn't print, and their bytes. */
+static const struct {
+	const char *text;
+	int len;
+	unsigned char bytes[2];
+} aliases[] = {
+	{ "in   a,p0", 1, { 0x08 } },		/* 8021: the opcode of ins a,bus */
+	{ "outl p0,a", 1, { 0x90 } },		/* 8021: the opcode of movx @r0,a */
+	{ "MOV  A,#$12", 2, { 0x23, 0x12 } },
+	{ "mov  a,#0x12", 2, { 0x23, 0x12 } },
+	{ "mov  a,12h", 2, { 0x23, 0x12 } },
+	{ "mov  r7,#%10100101", 2, { 0xBF, 0xA5 } },
+	{ "anl  a,#0FFh", 2, { 0x53, 0xFF } },
+	{ "jmp  0x7FF", 2, { 0xE4, 0xFF } },
+	{ NULL, 0, { 0 } }
+};
+
+static const char *assembler;
+static unsigned char image[CHUNK_SIZE];
+static int errors;
+
+/*
+ * Random numbers that are the same on every host.
+ */
+static unsigned long rand_state;
+
+static unsigned next_rand(void)
+{
+	rand_state = rand_state * 1103515245UL + 12345UL;
+	return (unsigned) (rand_state >> 16) & 0x7FFF;
+}
+
+/*
+ * Assemble the source file and compare the image with the bytes
+ * expected, describing each difference with its source line.
+ * lines[] holds the source line of each address, or NULL.
+ */
+static void check(const unsigned char *expect, int size, const char **lines, const char *what)
+{
+	char cmd[512];
+	unsigned char got[CHUNK_SIZE + 1];
+	int n, addr, line;
+	FILE *fp;
+
+	sprintf(cmd, "%s -o %s %s > %s 2>&1", assembler, BIN_FILE, SRC_FILE, LOG_FILE);
+	if (system(cmd) != 0) {
+		printf("%s: asm48 failed, see %s and %s\n", what, SRC_FILE, LOG_FILE);
+		exit(1);
+	}
+	fp = fopen(BIN_FILE, "rb");
+	if (fp == NULL) {
+		printf("%s: no %s\n", what, BIN_FILE);
+		exit(1);
+	}
+	n = fread(got, 1, sizeof(got), fp);
+	fclose(fp);
+
+	if (n != size && errors++ < MAX_REPORTS)
+		printf("%s: %d bytes assembled instead of %d\n", what, n, size);
+	for (addr = 0; addr < size && addr < n; addr++) {
+		if (got[addr] == expect[addr])
+			continue;
+		for (line = addr; line > 0 && lines[line] == NULL; line--)
+			;
+		if (errors++ < MAX_REPORTS)
+			printf("%s: %03X: '%s' assembles to %02X instead of %02X\n",
+				what, addr, lines[line] ? lines[line] : "?", got[addr], expect[addr]);
+	}
+}
+
+/*
+ * Write the image as source, one line per instruction, and check
+ * that it assembles back.  Bytes that aren't a whole instruction
+ * are written as .db.
+ */
+static void round_trip(int size, const char *what)
+{
+	static char text[CHUNK_SIZE][64];
+	static const char *lines[CHUNK_SIZE];
+	struct Dasm8039Context ctx;
+	int pc = 0, op;
+	FILE *fp = fopen(SRC_FILE, "w");
+
+	if (fp == NULL) {
+		printf("Couldn't write %s\n", SRC_FILE);
+		exit(1);
+	}
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.code = image;
+	memset(lines, 0, sizeof(lines));
+	while (pc < size) {
+		lines[pc] = text[pc];
+		op = Match8039(image[pc]);
+		if (op < 0 || pc + Length8039(op) > size) {
+			sprintf(text[pc], ".db   $%02X", image[pc]);
+			fprintf(fp, "\t%s\n", text[pc++]);
+		} else {
+			Dasm8039r(text[pc], pc, &ctx);
+			fprintf(fp, "\t%s\n", text[pc]);
+			pc += Length8039(op);
+		}
+	}
+	fclose(fp);
+	check(image, size, lines, what);
+}
+
+/*
+ * Every opcode with every operand value, a chunk at a time.
+ * Returns the number of encodings.
+ */
+static int all_encodings(void)
+{
+	char what[32];
+	int code, arg, op, len, size = PROLOGUE, chunk = 0, count = 0;
+
+	memset(image, 0x83, PROLOGUE);
+	for (code = 0; code < 256; code++) {
+		op = Match8039(code);
+		if (op < 0)
+			continue;
+		len = Length8039(op);
+		for (arg = 0; arg < (len == 2 ? 256 : 1); arg++) {
+			if (size + len > CHUNK_SIZE) {
+				sprintf(what, "encodings %d", chunk++);
+				round_trip(size, what);
+				size = PROLOGUE;
+			}
+			image[size++] = code;
+			if (len == 2)
+				image[size++] = arg;
+			count++;
+		}
+	}
+	sprintf(what, "encodings %d", chunk);
+	round_trip(size, what);
+	return count;
+}
+
+/*
+ * Random byte streams, undefined opcodes included.  Returns the
+ * number of bytes.
+ */
+static long random_streams(int streams)
+{
+	char what[32];
+	int i, addr, size;
+	long total = 0;
+
+	for (i = 0; i < streams; i++) {
+		size = PROLOGUE + 1 + next_rand() % (CHUNK_SIZE - PROLOGUE);
+		memset(image, 0x83, PROLOGUE);
+		for (addr = PROLOGUE; addr < size; addr++)
+			image[addr] = next_rand() & 0xFF;
+		total += size;
+		sprintf(what, "random stream %d", i);
+		round_trip(size, what);
+	}
+	return total;
+}
+
+/*
+ * The spellings only the assembler knows.
+ */
+static void check_aliases(void)
+{
+	static const char *lines[CHUNK_SIZE];
+	int i, size = 0;
+	FILE *fp = fopen(SRC_FILE, "w");
+
+	if (fp == NULL) {
+		printf("Couldn't write %s\n", SRC_FILE);
+		exit(1);
+	}
+	for (i = 0; aliases[i].text != NULL; i++) {
+		fprintf(fp, "\t%s\n", aliases[i].text);
+		lines[size] = aliases[i].text;
+		memcpy(image + size, aliases[i].bytes, aliases[i].len);
+		size += aliases[i].len;
+	}
+	fclose(fp);
+	check(image, size, lines, "aliases");
+}
+
+int main(int argc, char **argv)
+{
+	int encodings, streams = DEFAULT_STREAMS;
+	long bytes;
+
+	if (argc < 2 || argc > 4) {
+		fprintf(stderr, "Usage: isatest <asm48 command> [<seed> [<streams>]]\n");
+		exit(1);
+	}
+	assembler = argv[1];
+	rand_state = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+	if (argc > 3)
+		streams = atoi(argv[3]);
+
+	encodings = all_encodings();
+	bytes = random_streams(streams);
+	check_aliases();
+
+	if (errors > 0) {
+		printf("%d differences\n", errors);
+		return 1;
+	}
+	printf("%d encodings, %d random streams (%ld bytes) and %d aliases assemble back\n",
+		encodings, streams, bytes, (int) (sizeof(aliases) / sizeof(aliases[0])) - 1);
+	remove(SRC_FILE);
+	remove(BIN_FILE);
+	remove(LOG_FILE);
+	return 0;
+}
@@ -0,0 +1,22 @@
+;; -m puts a sel mb1 in front of a call into bank 1.  The routine
+;; called selects MB0 again before it returns, so the next call needs
+;; nothing.  The reset code runs into 0x003, which is no interrupt
+;; routine of its own.
+;; asm48 -m
+;; expect 000 00 00 00 04 10
+;; expect 010 F5 14 00 14 16 83 83
+;; expect 800 E5 83
+;; output Line 16: sel mb1 added for call to 0800
+	.org 0
+	nop
+	nop
+	nop
+	jmp start
+	.org 0x10
+start:	call far
+	call near
+	ret
+near:	ret
+	.org 0x800
+far:	sel mb0
+	ret
@@ -0,0 +1,12 @@
+;; An interrupt routine runs in bank 0 until RETR, whatever bank is
+;; selected, so a call from it into bank 1 is an error.
+;; error Line 7: call to 0800 from an interrupt routine, which runs in bank 0 until RETR
+	.org 0
+	jmp start
+	.org 7
+	call far
+	retr
+	.org 0x10
+start:	ret
+	.org 0x800
+far:	ret
@@ -0,0 +1,17 @@
+;; -d drops a data block found inside an earlier one and moves its
+;; label, and the equate of the label, to the copy.
+;; asm48 -d
+;; expect 000 23 06 A3 83 3C 66 7E 66 66 00 83
+;; size B
+;; symbol letter 6
+;; symbol LETTER 6
+;; output letter                   -> font+2,    3 bytes saved
+	.org 0
+	mov a,#LETTER
+	movp a,@a
+	ret
+font:	.db 0x3C, 0x66, 0x7E, 0x66, 0x66
+	nop
+letter:	.db 0x7E, 0x66, 0x66
+	ret
+	.equ LETTER, letter
@@ -0,0 +1,17 @@
+;; -O shrinks the code in front of a table; the table's label and
+;; its equate both follow it.
+;; asm48 -O
+;; expect 000 27 23 04 83 55
+;; size 5
+;; symbol tbl 4
+;; symbol TBLPTR 4
+;; output mov a,#0 -> clr a             1 times,    1 bytes,    1 cycles saved
+;; output call x; ret -> jmp x          1 times,    1 bytes,    2 cycles saved
+	.org 0
+	mov a,#0
+	call sub
+	ret
+sub:	mov a,#TBLPTR
+	ret
+tbl:	.db 0x55
+	.equ TBLPTR, tbl
@@ -0,0 +1,29 @@
+;; Equates of labels in sections placed by their constraints
+;; get the addresses the labels end up at.
+;; expect 010 23 00 23 04 23 02 23 02 83
+;; expect 200 01 02 03 04 05
+;; symbol TBL 0
+;; symbol TBL2 4
+;; symbol TBLPAGE 2
+;; symbol MSG 2
+	.org 0
+	jmp start
+	.org 0x10
+start:	mov a,#TBL
+	mov a,#TBL2
+	mov a,#TBLPAGE
+	mov a,#MSG
+	ret
+
+	.section tables, page 2
+tbl:	.db 1, 2, 3
+	.equ TBL, <tbl
+	.equ TBLPAGE, >tbl
+
+	.section more, with tables
+tbl2:	.db 4, 5
+	.equ TBL2, <tbl2 + 1
+
+	.section text, inpage
+msg:	.db 6
+	.equ MSG, msg
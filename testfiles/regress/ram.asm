@@ -0,0 +1,33 @@
+;; .ram variables: routines that are never active together share
+;; addresses, a callee's go above its caller's, the interrupt
+;; routine's above everything main code uses, and a variable outside
+;; any routine gets an address of its own.
+;; symbol x 20
+;; symbol y 21
+;; symbol freq 20
+;; symbol tmp 22
+;; symbol save 24
+;; symbol glob 25
+;; expect 018 B8 22 83 B8 20 83 B8 24 93
+	.org 0
+	jmp start
+	.org 3
+	jmp irq
+	.org 0x10
+start:	call draw
+	call sound
+	ret
+draw:	.ram x, 1
+	.ram y, 1
+	call plot
+	ret
+plot:	.ram tmp, 2
+	mov r0,#tmp
+	ret
+sound:	.ram freq, 1
+	mov r0,#freq
+	ret
+irq:	.ram save, 1
+	mov r0,#save
+	retr
+	.ram glob, 1
@@ -0,0 +1,20 @@
+;; -r rewrites a jz out of its page into jnz around a jmp; the label
+;; after it, and the equate of that label, move with the code.
+;; asm48 -r
+;; expect 000 04 02 23 09 96 08 24 00 83 55
+;; expect 100 23 09 83
+;; symbol msg 9
+;; symbol MSG 9
+;; output Line 17: jump to 0100 out of page, 2 bytes added
+	.org 0
+	jmp start
+	.org 0x100
+far:	mov a,#MSG
+	ret
+
+	.section main
+start:	mov a,#MSG
+	jz far
+	ret
+msg:	.db 0x55
+	.equ MSG, msg
@@ -0,0 +1,17 @@
+;; -u removes a routine nobody calls; the table after it, reached
+;; only through an equate, is kept and moves down with its equate.
+;; asm48 -u
+;; expect 010 23 13 83 55
+;; size 14
+;; symbol tbl 13
+;; symbol TP 13
+;; output 013 unused                      3 bytes
+	.org 0
+	jmp start
+	.org 0x10
+start:	mov a,#TP
+	ret
+unused:	mov a,#1
+	ret
+tbl:	.db 0x55
+	.equ TP, tbl
@@ -0,0 +1,20 @@
+;; -u drops the .ram variables of the routines it removes, instead
+;; of giving them addresses outside any routine.
+;; asm48 -u
+;; expect 010 14 13 83 B8 20 83
+;; size 16
+;; symbol u1 20
+;; symbol g1 22
+;; output 016 unused                      3 bytes
+	.org 0
+	jmp start
+	.org 0x10
+start:	call used
+	ret
+used:	.ram u1, 2
+	mov r0,#u1
+	ret
+unused:	.ram x1, 3
+	mov r0,#x1
+	ret
+	.ram g1, 1
@@ -0,0 +1,10 @@
+;; Tables of label addresses get the addresses the labels are
+;; placed at, including labels defined after the table.
+;; expect 000 83 09 0B 0D 0F 09 00 0A 00 01 02
+	.org 0
+	ret
+	.section ptrs
+ptrs:	.table 4, <(msgs + .index * 2)
+	.table 2, msgs + .index, 2
+	.section text
+msgs:	.db 1, 2, 3, 4, 5, 6, 7, 8
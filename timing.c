@@ -0,0 +1,1065 @@
+/*
+ * Assembler for the Intel 8048 microcontroller family.
+ * Copyright (c) 2003 David H. Hovemeyer <daveho@cs.umd.edu>
+ *
+ * Enhanced in 2012, 2013 by JustBurn and sy2002 of MEGA
+ * http://www.adventurevision.net
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Static timing analysis.  After assembly, a control flow graph
+ * is built from the machine code: jumps, calls, conditional
+ * branches, djnz and returns.  Best and worst case cycle counts
+ * are computed per routine (see routine.c) and between given
+ * points.  Loops count
+ * only when bounded by a .loop annotation on their backward
+ * branch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "asm48.h"
+
+#define UNBOUNDED LONG_MAX	/* Cycle count with no known bound. */
+
+/* Why a cycle count is missing or incomplete. */
+#define TF_LOOP		0x01	/* Loop without a .loop bound. */
+#define TF_INDIRECT	0x02	/* JMPP with unknown targets. */
+#define TF_RECURSION	0x04	/* Recursive call. */
+#define TF_NORETURN	0x08	/* Never returns (or never reaches the end point). */
+#define TF_RUNOFF	0x10	/* Runs into data or unassembled memory. */
+#define TF_IRREDUCIBLE	0x20	/* Loop with more than one entry. */
+
+/*
+ * Best and worst case cycles of a piece of code.
+ */
+struct Timing {
+	long best, worst;
+	int flags;
+};
+
+/*
+ * Timing of the routine at an address: a routine of routine.c,
+ * or any other call target analysed.
+ */
+struct RoutineTiming {
+	int state;		/* 0 = not analysed, 1 = in progress, 2 = done. */
+	struct Timing timing;
+};
+
+/*
+ * A point-to-point query given with -P.
+ */
+struct Path {
+	const char *from, *to;
+	struct Path *next;
+};
+
+/* Node and edge of a control flow graph being analysed. */
+struct Node {
+	int addr;
+	long cmax, cmin;	/* Cycles spent in the node. */
+	int rep;		/* Loop header the node has been merged into. */
+};
+
+struct Edge {
+	int from, to;
+	long wmax, wmin;	/* Cycles spent along the edge. */
+	int back;
+	int next;		/* Next edge in an adjacency list. */
+};
+
+/*
+ * A control flow graph.  Nodes are instructions; the last
+ * node is a virtual end node.
+ */
+struct Graph {
+	struct Node *nodes;
+	struct Edge *edges;
+	int num_nodes, num_edges, max_edges;
+	int *idx;		/* Node index by address, -1 if none. */
+	int flags;
+};
+
+static struct RoutineTiming *timing_at;
+static struct Path *path_head, *path_tail;
+
+/* Cycle count assertions, in source order. */
+struct CycleCheck *cycle_checks;
+static struct CycleCheck *cycle_checks_tail;
+
+/* .loop bounds waiting for the next instruction. */
+static int pending_min, pending_max = -1;
+
+/*
+ * Record the bounds of a .loop directive.  They apply to the
+ * next instruction, which should be the loop's backward branch.
+ */
+void set_loop_bound(int min, int max, int line_num)
+{
+	if (min < 0 || max < min) {
+		error_at(cur_file, line_num, 0, "Invalid loop bounds %d, %d", min, max);
+		return;
+	}
+	pending_min = min;
+	pending_max = max;
+}
+
+/*
+ * Give the pending .loop bounds, if any, to an instruction.
+ */
+void attach_loop_bound(struct Instruction *ins)
+{
+	if (pending_max < 0)
+		return;
+	ins->loop_min = pending_min;
+	ins->loop_max = pending_max;
+	pending_max = -1;
+}
+
+/*
+ * Add a cycle count assertion.
+ */
+struct CycleCheck *add_cycle_check(const char *name, struct Instruction *begin,
+	struct Instruction *end, int op, int cycles, int line_num)
+{
+	struct CycleCheck *check = pool_alloc_buf(gen_pool, sizeof(struct CycleCheck));
+
+	check->name = dup_str(name);
+	check->begin = begin;
+	check->end = end;
+	check->op = op;
+	check->cycles = cycles;
+	check->cur_file = cur_file;
+	check->line_num = line_num;
+	check->next = NULL;
+	if (cycle_checks_tail == NULL)
+		cycle_checks = cycle_checks_tail = check;
+	else {
+		cycle_checks_tail->next = check;
+		cycle_checks_tail = check;
+	}
+	return check;
+}
+
+/*
+ * Start a timed block (.cycles_begin directive).
+ */
+void cycles_begin(const char *name, int line_num)
+{
+	struct CycleCheck *check;
+
+	for (check = cycle_checks; check != NULL; check = check->next) {
+		if (check->end == NULL && strcmp(check->name, name) == 0) {
+			error_at(cur_file, line_num, 0, "Timed block %s is already open", name);
+			return;
+		}
+	}
+	add_cycle_check(name, mark(), NULL, 0, 0, line_num);
+}
+
+/*
+ * End a timed block (.cycles_end directive), with the bound
+ * its cycle count must meet.
+ */
+void cycles_end(const char *name, int op, int cycles, int line_num)
+{
+	struct CycleCheck *check;
+
+	for (check = cycle_checks; check != NULL; check = check->next) {
+		if (check->end == NULL && strcmp(check->name, name) == 0)
+			break;
+	}
+	if (check == NULL) {
+		error_at(cur_file, line_num, 0, ".cycles_end without .cycles_begin for %s", name);
+		return;
+	}
+	check->end = mark();
+	check->op = op;
+	check->cycles = cycles;
+	check->cur_file = cur_file;
+	check->line_num = line_num;
+}
+
+/*
+ * Add a point-to-point query ("from,to") to the timing report.
+ */
+void add_timing_path(const char *spec)
+{
+	struct Path *path = malloc(sizeof(struct Path));
+	char *from = strdup(spec), *to = strchr(from, ',');
+
+	if (path == NULL || from == NULL)
+		err_printf("Unable to allocate timing path\n");
+	if (to == NULL) {
+		fprintf(stderr, "Timing path \"%s\" must be given as from,to\n", spec);
+		exit(1);
+	}
+	*to++ = '\0';
+	path->from = from;
+	path->to = to;
+	path->next = NULL;
+	if (path_tail == NULL)
+		path_head = path_tail = path;
+	else {
+		path_tail->next = path;
+		path_tail = path;
+	}
+}
+
+/* Machine cycles of each opcode, from the instruction set table. */
+static const struct {
+	const char *encoding;
+	int cycles;
+} isa[] = {
+#define INSN(encoding, format, cycles) { encoding, cycles },
+#include "isa48.h"
+#undef INSN
+	{ NULL, 0 }
+};
+
+static unsigned char opcode_cycles[256];	/* 0 until built, and for invalid opcodes. */
+static int have_opcode_cycles;
+
+/*
+ * Fill opcode_cycles[] from the first byte of each encoding.
+ */
+static void build_opcode_cycles(void)
+{
+	int i, code, bit, mask, bits;
+	const char *p;
+
+	for (i = 0; isa[i].encoding != NULL; i++) {
+		mask = bits = 0;
+		for (p = isa[i].encoding, bit = 7; *p != '\0' && bit >= 0; p++) {
+			if (*p == ' ')
+				continue;
+			if (*p == '0' || *p == '1')
+				mask |= 1 << bit;
+			if (*p == '1')
+				bits |= 1 << bit;
+			bit--;
+		}
+		for (code = 0; code < 256; code++) {
+			if ((code & mask) == bits)
+				opcode_cycles[code] = isa[i].cycles;
+		}
+	}
+	have_opcode_cycles = 1;
+}
+
+/*
+ * Return the number of machine cycles an instruction takes.
+ * Bytes that aren't an opcode count as one cycle per byte.
+ */
+int instruction_cycles(const unsigned char *buf, int size)
+{
+	if (!have_opcode_cycles)
+		build_opcode_cycles();
+	if (opcode_cycles[buf[0]] != 0)
+		return opcode_cycles[buf[0]];
+	return size == 2 ? 2 : 1;
+}
+
+/*
+ * Is an opcode a conditional jump within the page?
+ */
+static int is_branch(int op)
+{
+	switch (op) {
+		case 0x16: case 0x26: case 0x36: case 0x46: case 0x56: case 0x76:
+		case 0x86: case 0x96: case 0xB6: case 0xC6: case 0xE6: case 0xF6:
+			return 1;
+	}
+	return (op & 0x1F) == 0x12 || (op & 0xF8) == 0xE8;	/* JBb, DJNZ */
+}
+
+/*
+ * Classify the control flow of a code instruction, and find
+ * its target address.  The target of a jump or call is the
+ * address its operand names; without one (code linked from an
+ * object file), it stays in the bank of the instruction.
+ * Works before the instruction is assembled, too.
+ */
+int instruction_flow(struct Instruction *ins, int *target)
+{
+	int op = ins->buf[0];
+	int known = ins->expr != NULL && expr_is_defined(ins->expr);
+
+	if (ins->size == 2) {
+		if ((op & 0x1F) == 0x04 || (op & 0x1F) == 0x14) {
+			if (known)
+				*target = eval_expr(ins->cur_file, ins->expr) & (MAX_ADDR - 1);
+			else
+				*target = (ins->offset & BANK_SIZE) | ((op & 0xE0) << 3) | ins->buf[1];
+			*target |= ins->offset & ~(MAX_ADDR - 1);
+			return (op & 0x1F) == 0x04 ? FLOW_JUMP : FLOW_CALL;
+		}
+		if (is_branch(op)) {
+			*target = ((ins->offset + 1) & PAGE_MASK)
+				| ((known ? eval_expr(ins->cur_file, ins->expr) : ins->buf[1]) & 0xFF);
+			return FLOW_BRANCH;
+		}
+	} else if (op == 0x83 || op == 0x93) {
+		return FLOW_RET;
+	} else if (op == 0xB3) {
+		return FLOW_INDIRECT;
+	}
+	return FLOW_NEXT;
+}
+
+static long sat_add(long a, long b)
+{
+	return (a == UNBOUNDED || b == UNBOUNDED) ? UNBOUNDED : a + b;
+}
+
+static long sat_mul(long n, long a)
+{
+	if (n == 0 || a == 0)
+		return 0;
+	return (n == UNBOUNDED || a == UNBOUNDED) ? UNBOUNDED : n * a;
+}
+
+static struct Timing routine_timing(int addr);
+
+/*
+ * Add a node for the instruction at an address, unless it is
+ * already in the graph.  Returns the node index, -1 if there is
+ * no code there.
+ */
+static int add_node(struct Graph *g, int addr, int *work, int *num_work)
+{
+	struct Node *node;
+
+	if (addr < 0 || addr >= MAX_ADDR || code_at[addr] == NULL)
+		return -1;
+	if (g->idx[addr] >= 0)
+		return g->idx[addr];
+
+	node = &g->nodes[g->num_nodes];
+	node->addr = addr;
+	node->cmax = node->cmin = instruction_cycles(code_at[addr]->buf, code_at[addr]->size);
+	node->rep = g->num_nodes;
+	g->idx[addr] = g->num_nodes;
+	work[(*num_work)++] = addr;
+	return g->num_nodes++;
+}
+
+static void add_edge(struct Graph *g, int from, int to)
+{
+	struct Edge *e;
+
+	if (g->num_edges == g->max_edges) {
+		g->max_edges *= 2;
+		g->edges = realloc(g->edges, g->max_edges * sizeof(struct Edge));
+		if (g->edges == NULL)
+			err_printf("Unable to allocate timing graph\n");
+	}
+	e = &g->edges[g->num_edges++];
+	e->from = from;
+	e->to = to;
+	e->wmax = e->wmin = 0;
+	e->back = 0;
+}
+
+/*
+ * Add the edge from a node to its successor at an address.
+ */
+static void add_successor(struct Graph *g, int from, int addr, int end, int *work, int *num_work)
+{
+	int to = add_node(g, addr, work, num_work);
+
+	if (to < 0) {
+		g->flags |= TF_RUNOFF;
+		add_edge(g, from, end);
+	} else
+		add_edge(g, from, to);
+}
+
+/*
+ * Build the control flow graph reachable from an entry point.
+ * Returns end at the stop address if stop >= 0, otherwise at
+ * returns.
+ */
+static void build_graph(struct Graph *g, int entry, int stop)
+{
+	struct Instruction *ins;
+	struct Timing callee;
+	int *work = malloc(MAX_ADDR * sizeof(int));
+	int num_work = 0, i, j, n, addr, flow, target, next;
+	int targets[256], num_targets;
+	int end = MAX_ADDR;	/* Index of the end node until the graph is complete. */
+
+	g->nodes = malloc((MAX_ADDR + 1) * sizeof(struct Node));
+	g->idx = malloc(MAX_ADDR * sizeof(int));
+	g->max_edges = 1024;
+	g->edges = malloc(g->max_edges * sizeof(struct Edge));
+	if (work == NULL || g->nodes == NULL || g->idx == NULL || g->edges == NULL)
+		err_printf("Unable to allocate timing graph\n");
+	for (i = 0; i < MAX_ADDR; i++)
+		g->idx[i] = -1;
+	g->num_nodes = g->num_edges = 0;
+	g->flags = 0;
+
+	if (add_node(g, entry, work, &num_work) < 0)
+		g->flags |= TF_RUNOFF;
+
+	for (i = 0; i < num_work; i++) {
+		addr = work[i];
+		n = g->idx[addr];
+		ins = code_at[addr];
+		if (addr == stop) {
+			g->nodes[n].cmax = g->nodes[n].cmin = 0;
+			add_edge(g, n, end);
+			continue;
+		}
+
+		flow = instruction_flow(ins, &target);
+		next = addr + ins->size;
+		switch (flow) {
+			case FLOW_NEXT:
+				add_successor(g, n, next, end, work, &num_work);
+				break;
+			case FLOW_JUMP:
+				add_successor(g, n, target, end, work, &num_work);
+				break;
+			case FLOW_BRANCH:
+				add_successor(g, n, next, end, work, &num_work);
+				add_successor(g, n, target, end, work, &num_work);
+				break;
+			case FLOW_CALL:
+				callee = routine_timing(target);
+				g->flags |= callee.flags & ~TF_NORETURN;
+				g->nodes[n].cmax = sat_add(g->nodes[n].cmax, callee.worst);
+				g->nodes[n].cmin = sat_add(g->nodes[n].cmin, callee.best);
+				add_successor(g, n, next, end, work, &num_work);
+				break;
+			case FLOW_RET:
+				if (stop < 0)
+					add_edge(g, n, end);
+				break;
+			case FLOW_INDIRECT:
+				num_targets = jump_table_targets(ins, targets, 256);
+				for (j = 0; j < num_targets; j++)
+					add_successor(g, n, targets[j], end, work, &num_work);
+				if (num_targets >= 0)
+					break;
+				g->flags |= TF_INDIRECT;
+				if (stop < 0)
+					add_edge(g, n, end);
+				break;
+		}
+	}
+
+	/* Move the end node to its final index. */
+	end = g->num_nodes++;
+	g->nodes[end].addr = -1;
+	g->nodes[end].cmax = g->nodes[end].cmin = 0;
+	g->nodes[end].rep = end;
+	for (i = 0; i < g->num_edges; i++) {
+		if (g->edges[i].to == MAX_ADDR)
+			g->edges[i].to = end;
+	}
+	free(work);
+}
+
+/*
+ * Link the edges accepted by a filter into per-node adjacency
+ * lists.  first[] must have room for every node.
+ */
+static void link_edges(struct Graph *g, int *first, const int *in_set, int stamp, int skip_to)
+{
+	struct Edge *e;
+	int i;
+
+	for (i = 0; i < g->num_nodes; i++)
+		first[i] = -1;
+	for (i = g->num_edges - 1; i >= 0; i--) {
+		e = &g->edges[i];
+		if (e->from < 0 || e->to == skip_to)
+			continue;
+		if (in_set != NULL && (in_set[e->from] != stamp || in_set[e->to] != stamp))
+			continue;
+		e->next = first[e->from];
+		first[e->from] = i;
+	}
+}
+
+/*
+ * Mark the back edges: edges to a node on the current path of
+ * a depth first search from the entry.
+ */
+static void find_back_edges(struct Graph *g, int entry)
+{
+	int *first = malloc(g->num_nodes * sizeof(int));
+	int *cursor = malloc(g->num_nodes * sizeof(int));
+	int *stack = malloc(g->num_nodes * sizeof(int));
+	char *state = calloc(g->num_nodes, 1);	/* 1 = on path, 2 = finished */
+	int sp = 0, n, i;
+
+	if (first == NULL || cursor == NULL || stack == NULL || state == NULL)
+		err_printf("Unable to allocate timing graph\n");
+	link_edges(g, first, NULL, 0, -1);
+
+	stack[sp++] = entry;
+	state[entry] = 1;
+	cursor[entry] = first[entry];
+	while (sp > 0) {
+		n = stack[sp - 1];
+		i = cursor[n];
+		if (i < 0) {
+			state[n] = 2;
+			sp--;
+			continue;
+		}
+		cursor[n] = g->edges[i].next;
+		if (state[g->edges[i].to] == 1) {
+			g->edges[i].back = 1;
+		} else if (state[g->edges[i].to] == 0) {
+			n = g->edges[i].to;
+			state[n] = 1;
+			cursor[n] = first[n];
+			stack[sp++] = n;
+		}
+	}
+
+	free(first);
+	free(cursor);
+	free(stack);
+	free(state);
+}
+
+static int find_rep(struct Graph *g, int n)
+{
+	while (g->nodes[n].rep != n)
+		n = g->nodes[n].rep = g->nodes[g->nodes[n].rep].rep;
+	return n;
+}
+
+/*
+ * Longest and shortest paths from a node over the linked edges,
+ * which must form a DAG.  Unreached nodes get dmax < 0.  Returns
+ * 0 if a cycle was found.
+ */
+static int longest_paths(struct Graph *g, int start, const int *first, long *dmax, long *dmin)
+{
+	int *indeg = calloc(g->num_nodes, sizeof(int));
+	int *queue = malloc(g->num_nodes * sizeof(int));
+	int head = 0, tail = 0, n, i, count = 0, ok;
+	struct Edge *e;
+
+	if (indeg == NULL || queue == NULL)
+		err_printf("Unable to allocate timing graph\n");
+
+	/* Only nodes reachable from the start take part. */
+	for (i = 0; i < g->num_nodes; i++)
+		dmax[i] = -1;
+	queue[tail++] = start;
+	dmax[start] = 0;
+	while (head < tail) {
+		n = queue[head++];
+		for (i = first[n]; i >= 0; i = e->next) {
+			e = &g->edges[i];
+			indeg[e->to]++;
+			if (dmax[e->to] < 0) {
+				dmax[e->to] = 0;
+				queue[tail++] = e->to;
+			}
+		}
+	}
+	count = tail;
+
+	for (i = 0; i < g->num_nodes; i++)
+		dmax[i] = dmin[i] = -1;
+	dmax[start] = g->nodes[start].cmax;
+	dmin[start] = g->nodes[start].cmin;
+	head = tail = 0;
+	queue[tail++] = start;
+	while (head < tail) {
+		n = queue[head++];
+		for (i = first[n]; i >= 0; i = e->next) {
+			long vmax, vmin;
+			e = &g->edges[i];
+			vmax = sat_add(sat_add(dmax[n], e->wmax), g->nodes[e->to].cmax);
+			vmin = sat_add(sat_add(dmin[n], e->wmin), g->nodes[e->to].cmin);
+			if (dmax[e->to] < 0 || vmax > dmax[e->to])
+				dmax[e->to] = vmax;
+			if (dmin[e->to] < 0 || vmin < dmin[e->to])
+				dmin[e->to] = vmin;
+			if (--indeg[e->to] == 0)
+				queue[tail++] = e->to;
+		}
+	}
+
+	ok = tail == count;
+	free(indeg);
+	free(queue);
+	return ok;
+}
+
+/*
+ * Analyse the code reachable from an entry point, up to the stop
+ * address if stop >= 0, otherwise up to its returns.
+ *
+ * Loops are collapsed innermost first.  A loop's header becomes
+ * a single node costing (bound) x (longest iteration); each edge
+ * leaving the loop carries the cost of the last, partial pass.
+ * What remains is a DAG whose longest and shortest paths to the
+ * end node are the worst and best cases.
+ */
+static struct Timing analyse(int entry, int stop)
+{
+	struct Graph g;
+	struct Timing t;
+	struct Instruction *ins;
+	struct Edge *e;
+	int *first, *rfirst, *rnext, *in_set, *hdr, *body_start, *body, *work;
+	long *dmax, *dmin, *nmax, *nmin, imax, imin;
+	int num_hdr = 0, num_body = 0, num_work, i, j, k, h, x, end, fin, tin;
+
+	build_graph(&g, entry, stop);
+	t.flags = g.flags;
+	end = g.num_nodes - 1;
+	if (end == 0) {
+		t.best = t.worst = 0;
+		return t;
+	}
+	find_back_edges(&g, 0);
+
+	first = malloc(g.num_nodes * sizeof(int));
+	rfirst = malloc(g.num_nodes * sizeof(int));
+	rnext = malloc(g.num_edges * sizeof(int));
+	in_set = calloc(g.num_nodes, sizeof(int));
+	hdr = malloc(g.num_nodes * sizeof(int));
+	work = malloc(g.num_nodes * sizeof(int));
+	dmax = malloc(g.num_nodes * sizeof(long));
+	dmin = malloc(g.num_nodes * sizeof(long));
+	nmax = malloc(g.num_nodes * sizeof(long));
+	nmin = malloc(g.num_nodes * sizeof(long));
+	body_start = malloc((g.num_nodes + 1) * sizeof(int));
+	body = NULL;
+	if (first == NULL || rfirst == NULL || rnext == NULL || in_set == NULL || hdr == NULL
+	    || work == NULL || dmax == NULL || dmin == NULL || nmax == NULL || nmin == NULL
+	    || body_start == NULL)
+		err_printf("Unable to allocate timing graph\n");
+
+	/* Loop headers and their bounds. */
+	for (i = 0; i < g.num_nodes; i++) {
+		nmax[i] = -1;
+		rfirst[i] = -1;
+	}
+	for (i = 0; i < g.num_edges; i++) {
+		e = &g.edges[i];
+		rnext[i] = rfirst[e->to];
+		rfirst[e->to] = i;
+		if (!e->back)
+			continue;
+		if (nmax[e->to] < 0) {
+			nmax[e->to] = nmin[e->to] = 0;
+			hdr[num_hdr++] = e->to;
+		}
+		ins = code_at[g.nodes[e->from].addr];
+		if (ins->loop_max < 0) {
+			nmax[e->to] = UNBOUNDED;
+			t.flags |= TF_LOOP;
+		} else {
+			nmax[e->to] = sat_add(nmax[e->to], ins->loop_max);
+			nmin[e->to] += ins->loop_min;
+		}
+	}
+
+	/* Natural loop bodies: nodes reaching a back edge without passing the header. */
+	for (k = 0; k < num_hdr; k++) {
+		h = hdr[k];
+		body_start[k] = num_body;
+		body = realloc(body, (num_body + g.num_nodes) * sizeof(int));
+		if (body == NULL)
+			err_printf("Unable to allocate timing graph\n");
+		in_set[h] = k + 1;
+		body[num_body++] = h;
+		num_work = 0;
+		for (i = rfirst[h]; i >= 0; i = rnext[i]) {
+			if (g.edges[i].back && in_set[g.edges[i].from] != k + 1) {
+				in_set[g.edges[i].from] = k + 1;
+				work[num_work++] = g.edges[i].from;
+			}
+		}
+		while (num_work > 0) {
+			x = work[--num_work];
+			body[num_body++] = x;
+			for (i = rfirst[x]; i >= 0; i = rnext[i]) {
+				if (in_set[g.edges[i].from] != k + 1) {
+					in_set[g.edges[i].from] = k + 1;
+					work[num_work++] = g.edges[i].from;
+				}
+			}
+		}
+	}
+	body_start[num_hdr] = num_body;
+
+	/* Collapse the loops, smallest (innermost) first. */
+	for (i = 0; i < num_hdr; i++)
+		work[i] = i;
+	for (i = 1; i < num_hdr; i++) {
+		for (j = i; j > 0; j--) {
+			int a = work[j - 1], b = work[j];
+			if (body_start[a + 1] - body_start[a] <= body_start[b + 1] - body_start[b])
+				break;
+			work[j - 1] = b;
+			work[j] = a;
+		}
+	}
+	for (i = 0; i < g.num_nodes; i++)
+		in_set[i] = 0;
+
+	for (j = 0; j < num_hdr; j++) {
+		k = work[j];
+		h = hdr[k];
+		if (find_rep(&g, h) != h) {
+			t.flags |= TF_IRREDUCIBLE;
+			continue;
+		}
+		for (i = body_start[k]; i < body_start[k + 1]; i++)
+			in_set[find_rep(&g, body[i])] = -(k + 1);
+
+		link_edges(&g, first, in_set, -(k + 1), h);
+		if (!longest_paths(&g, h, first, dmax, dmin))
+			t.flags |= TF_IRREDUCIBLE;
+
+		/* Longest and shortest iteration. */
+		imax = -1;
+		imin = UNBOUNDED;
+		for (i = 0; i < g.num_edges; i++) {
+			e = &g.edges[i];
+			if (e->from < 0 || e->to != h || in_set[e->from] != -(k + 1) || dmax[e->from] < 0)
+				continue;
+			if (sat_add(dmax[e->from], e->wmax) > imax)
+				imax = sat_add(dmax[e->from], e->wmax);
+			if (sat_add(dmin[e->from], e->wmin) < imin)
+				imin = sat_add(dmin[e->from], e->wmin);
+		}
+		if (imax < 0)
+			imax = imin = 0;
+
+		/* Replace the loop by its header. */
+		for (i = 0; i < g.num_edges; i++) {
+			e = &g.edges[i];
+			if (e->from < 0)
+				continue;
+			fin = in_set[e->from] == -(k + 1);
+			tin = in_set[e->to] == -(k + 1);
+			if (fin && tin) {
+				e->from = -1;
+			} else if (fin) {
+				if (dmax[e->from] < 0) {
+					e->from = -1;
+					continue;
+				}
+				e->wmax = sat_add(dmax[e->from], e->wmax);
+				e->wmin = sat_add(dmin[e->from], e->wmin);
+				e->from = h;
+			} else if (tin) {
+				if (e->to != h)
+					t.flags |= TF_IRREDUCIBLE;
+				e->to = h;
+			}
+		}
+		for (i = body_start[k]; i < body_start[k + 1]; i++) {
+			x = find_rep(&g, body[i]);
+			in_set[x] = 0;
+			g.nodes[x].rep = h;
+		}
+		g.nodes[h].cmax = sat_mul(nmax[h], imax);
+		g.nodes[h].cmin = sat_mul(nmin[h], imin);
+	}
+
+	/* What remains is acyclic. */
+	link_edges(&g, first, NULL, 0, -1);
+	if (!longest_paths(&g, find_rep(&g, 0), first, dmax, dmin))
+		t.flags |= TF_IRREDUCIBLE;
+	if (dmax[end] < 0) {
+		t.flags |= TF_NORETURN;
+		t.best = t.worst = UNBOUNDED;
+	} else {
+		t.worst = dmax[end];
+		t.best = dmin[end];
+	}
+	if (t.flags & (TF_LOOP | TF_RECURSION | TF_IRREDUCIBLE))
+		t.worst = UNBOUNDED;
+
+	free(first);
+	free(rfirst);
+	free(rnext);
+	free(in_set);
+	free(hdr);
+	free(work);
+	free(dmax);
+	free(dmin);
+	free(nmax);
+	free(nmin);
+	free(body_start);
+	free(body);
+	free(g.nodes);
+	free(g.edges);
+	free(g.idx);
+	return t;
+}
+
+/*
+ * Return the timing of the routine at an address.
+ */
+static struct Timing routine_timing(int addr)
+{
+	struct RoutineTiming *r;
+	struct Timing t;
+
+	if (addr < 0 || addr >= MAX_ADDR || code_at[addr] == NULL) {
+		t.best = t.worst = 0;
+		t.flags = TF_RUNOFF;
+		return t;
+	}
+	r = &timing_at[addr];
+	if (r->state == 1) {
+		t.best = 0;
+		t.worst = UNBOUNDED;
+		t.flags = TF_RECURSION;
+		return t;
+	}
+	if (r->state == 0) {
+		r->state = 1;
+		r->timing = analyse(addr, -1);
+		r->state = 2;
+	}
+	return r->timing;
+}
+
+/*
+ * Name of a routine or point: its label, or its address.
+ */
+static const char *point_name(int addr, const char **label_at)
+{
+	static char buf[4][16];
+	static int n;
+
+	if (label_at[addr] != NULL)
+		return label_at[addr];
+	if (addr == 0)
+		return "(reset)";
+	if (addr == 3)
+		return "(interrupt)";
+	if (addr == 7)
+		return "(timer)";
+	n = (n + 1) % 4;
+	sprintf(buf[n], "$%03X", addr);
+	return buf[n];
+}
+
+static const char *cycles_str(long cycles, char *buf)
+{
+	if (cycles == UNBOUNDED)
+		return "-";
+	sprintf(buf, "%ld", cycles);
+	return buf;
+}
+
+static void write_notes(FILE *fp, int flags)
+{
+	static const struct { int flag; const char *text; } notes[] = {
+		{ TF_NORETURN, "never returns" },
+		{ TF_LOOP, "unbounded loop" },
+		{ TF_IRREDUCIBLE, "loop with several entries" },
+		{ TF_RECURSION, "recursion" },
+		{ TF_INDIRECT, "indirect jump" },
+		{ TF_RUNOFF, "runs into data" },
+		{ 0, NULL }
+	};
+	const char *sep = "\t";
+	int i;
+
+	for (i = 0; notes[i].text != NULL; i++) {
+		if (flags & notes[i].flag) {
+			fprintf(fp, "%s%s", sep, notes[i].text);
+			sep = ", ";
+		}
+	}
+	fprintf(fp, "\n");
+}
+
+/*
+ * Resolve a timing point given as a label or an address.
+ */
+static int point_addr(const char *name)
+{
+	struct Symbol *sym = lookup_symbol(name);
+	char *end;
+	long value;
+
+	if (sym != NULL && sym->type == SYMB_LABEL)
+		return sym->value;
+	value = strtol(name, &end, 0);
+	if (*end != '\0' || value < 0 || value >= MAX_ADDR) {
+		error_at(NULL, 0, 0, "Unknown timing point %s", name);
+		return -1;
+	}
+	return value;
+}
+
+/*
+ * Find the routines of the assembled program.
+ */
+static void init_timing(void)
+{
+	find_routines();
+	if (timing_at != NULL)
+		return;
+	timing_at = calloc(MAX_ADDR, sizeof(struct RoutineTiming));
+	if (timing_at == NULL)
+		err_printf("Unable to allocate timing tables\n");
+}
+
+/*
+ * Check the cycle count assertions of .cycles_begin/.cycles_end
+ * blocks against the best and worst case over every path from
+ * the start of the block to its end.
+ */
+void check_cycles(void)
+{
+	struct CycleCheck *check;
+	struct Timing t;
+	char b1[24], b2[24];
+	const char *what;
+	int ok;
+
+	if (cycle_checks == NULL)
+		return;
+	init_timing();
+
+	for (check = cycle_checks; check != NULL; check = check->next) {
+		if (check->end == NULL) {
+			error_at(check->cur_file, check->line_num, 0, "Timed block %s is never closed", check->name);
+			continue;
+		}
+		t = analyse(check->begin->offset, check->end->offset);
+		switch (check->op) {
+			case '=':
+				ok = t.best == check->cycles && t.worst == check->cycles;
+				what = "exactly";
+				break;
+			case '<':
+				ok = t.worst <= check->cycles;
+				what = "at most";
+				break;
+			default:
+				ok = t.best >= check->cycles && t.best != UNBOUNDED;
+				what = "at least";
+				break;
+		}
+		if (!ok)
+			error_at(check->cur_file, check->line_num, 0, "Timed block %s takes %s..%s cycles, %s %d required",
+				check->name, cycles_str(t.best, b1), cycles_str(t.worst, b2), what, check->cycles);
+	}
+}
+
+/*
+ * Analyse the timing of the assembled program.  Writes the report
+ * to report_file (stdout if NULL) and the call graph in DOT form
+ * to graph_file, if given.
+ */
+void write_timing(const char *report_file, const char *graph_file)
+{
+	const char **label_at = calloc(MAX_ADDR, sizeof(char *));
+	struct Symbol *sym;
+	struct Routine *r;
+	struct Path *path;
+	struct Timing t, rt;
+	char b1[24], b2[24];
+	int addr, from, to, i;
+	FILE *fp;
+
+	if (label_at == NULL)
+		err_printf("Unable to allocate timing tables\n");
+	init_timing();
+
+	for (sym = first_symbol(); sym != NULL; sym = sym->next) {
+		if (sym->type == SYMB_LABEL && sym->value >= 0 && sym->value < MAX_ADDR
+				&& (sym->ins == NULL || sym->ins->offset < MAX_ADDR))
+			label_at[sym->value] = sym->name;
+	}
+
+	for (i = 0; i < num_routines; i++)
+		routine_timing(routines[i].addr);
+
+	if (report_file != NULL || path_head != NULL) {
+		fp = report_file != NULL ? fopen(report_file, "w") : stdout;
+		if (fp == NULL)
+			err_printf("Couldn't open timing report %s\n", report_file);
+
+		fprintf(fp, "; *** asm48 v" VERSION " timing ***\n");
+		fprintf(fp, "\n; Routines: address, name, best and worst case cycles\n");
+		for (addr = 0; addr < MAX_ADDR; addr++) {
+			if (routine_at[addr] < 0)
+				continue;
+			rt = timing_at[addr].timing;
+			fprintf(fp, "%04X\t%s\t%s\t%s", addr, point_name(addr, label_at),
+				cycles_str(rt.best, b1), cycles_str(rt.worst, b2));
+			write_notes(fp, rt.flags);
+		}
+
+		if (path_head != NULL)
+			fprintf(fp, "\n; Paths: from, to, best and worst case cycles\n");
+		for (path = path_head; path != NULL; path = path->next) {
+			from = point_addr(path->from);
+			to = point_addr(path->to);
+			if (from < 0 || to < 0)
+				continue;
+			t = analyse(from, to);
+			fprintf(fp, "%s\t%s\t%s\t%s", path->from, path->to,
+				cycles_str(t.best, b1), cycles_str(t.worst, b2));
+			write_notes(fp, t.flags);
+		}
+
+		if (fp != stdout)
+			fclose(fp);
+	}
+
+	if (graph_file != NULL) {
+		fp = fopen(graph_file, "w");
+		if (fp == NULL)
+			err_printf("Couldn't open call graph %s\n", graph_file);
+		fprintf(fp, "digraph calls {\n\tnode [shape=box];\n");
+		for (r = routines; r < routines + num_routines; r++) {
+			rt = timing_at[r->addr].timing;
+			fprintf(fp, "\tr%04X [label=\"%s\\n%s..%s cycles\"];\n", r->addr,
+				point_name(r->addr, label_at), cycles_str(rt.best, b1), cycles_str(rt.worst, b2));
+		}
+		for (r = routines; r < routines + num_routines; r++) {
+			for (i = 0; i < r->num_callees; i++)
+				fprintf(fp, "\tr%04X -> r%04X;\n", r->addr, routines[r->callees[i]].addr);
+		}
+		fprintf(fp, "}\n");
+		fclose(fp);
+	}
+
+	free(label_at);
+}